@@ -0,0 +1,100 @@
+// Copyright (c) 2015 Thiago Pereira Bueno
+// All Rights Reserved.
+//
+// This file is part of DBN library.
+//
+// DBN is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// DBN is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DBN.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef _DBN_ADDCONTEXT_H
+#define _DBN_ADDCONTEXT_H
+
+#include "variable.h"
+#include "cuddObj.hh"
+
+#include <iostream>
+#include <vector>
+#include <unordered_map>
+#include <cstddef>
+
+namespace dbn {
+
+	// manager counters (times in ms, memory in bytes)
+	struct ADDStatistics {
+		long live_nodes = 0;
+		long peak_live_nodes = 0;
+		double cache_hits = 0.0;
+		double cache_lookups = 0.0;
+		long garbage_collections = 0;
+		long garbage_collection_time = 0;
+		long reorderings = 0;
+		long reordering_time = 0;
+		std::size_t memory = 0;
+
+		double cache_hit_rate() const { return cache_lookups > 0.0 ? cache_hits / cache_lookups : 0.0; }
+
+		// semicolon separated columns, as in the main output
+		void print_columns(std::ostream &os) const;
+	};
+
+	// Decision diagram manager of one filtering session: the CUDD manager
+	// and the binary encoding of the model variables. Diagrams of different
+	// contexts never mix, so independent sessions may run on separate
+	// threads; all nodes are released when the context is destroyed, which
+	// must happen after the last ADDFactor built on it.
+	class ADDContext {
+	public:
+		ADDContext();
+		~ADDContext();
+
+		// owns its manager and every node built on it
+		ADDContext(const ADDContext&) = delete;
+		ADDContext &operator=(const ADDContext&) = delete;
+
+		Cudd &mgr() { return _mgr; }
+		void set_reordering(int *permutation = nullptr);
+
+		// a k-ary variable is encoded by ceil(log2 k) ADD variables (most
+		// significant bit first); codes >= k are invalid and map to zero
+		const std::vector<int> &bits(const Variable *variable);
+		ADD code(const Variable *variable, unsigned value);
+		ADD mask(const Variable *variable);
+
+		// allocate the bits of variables next to each other (interleaved
+		// bit by bit) and bind them as a group that sifting moves together
+		void group(const std::vector<const Variable*> &variables);
+		void reorder();
+
+		// counters since the context was created; record_step() keeps a
+		// snapshot per filtering step, reports the manager memory to the
+		// MemoryAccountant, caps CUDD to the remaining budget and throws
+		// MemoryLimitExceeded when it is over the limit
+		ADDStatistics statistics() const;
+		void record_step();
+		const std::vector<ADDStatistics> &steps() const { return _steps; }
+		void write_statistics(std::ostream &os) const;
+
+	private:
+		void account();
+
+		Cudd _mgr;
+		std::unordered_map<unsigned,std::vector<int>> _encoding;
+		int _next_index;
+		std::vector<ADDStatistics> _steps;
+		std::size_t _bytes;
+	};
+
+}
+
+#endif
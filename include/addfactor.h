@@ -22,22 +22,34 @@
 #include "factor.h"
 #include "domain.h"
 #include "variable.h"
+#include "addcontext.h"
 #include "cuddObj.hh"
 
 #include <iostream>
 #include <vector>
 #include <unordered_map>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
 
 namespace dbn {
 
 	class ADDFactor {
 	public:
-		static Cudd mgr;
-		static void set_mgr_reordering(int *permutation = nullptr);
+		// flat form of a diagram, independent of the manager: children come
+		// before their parents, the root is last and leaves have index -1
+		struct Node {
+			double value;
+			int32_t index;
+			uint32_t high;
+			uint32_t low;
+			uint32_t unused;
+		};
 
-		ADDFactor(const std::string &output = "T", double value = 1.0);
-		ADDFactor(const std::string &output, const Factor &factor);
-		ADDFactor(const std::string &output, const ADD &dd, const Domain &domain);
+		ADDFactor(ADDContext &context, const std::string &output = "T", double value = 1.0);
+		ADDFactor(ADDContext &context, const std::string &output, const Factor &factor);
+		ADDFactor(ADDContext &context, const std::string &output, const ADD &dd, const Domain &domain);
+		ADDFactor(ADDContext &context, const std::string &output, const Node *nodes, std::size_t count, const Domain &domain);
 		ADDFactor(const ADDFactor &f);
 		ADDFactor(ADDFactor &&f);
 
@@ -46,24 +58,50 @@ namespace dbn {
 		void operator*=(const ADDFactor &f);
 		double operator[](std::vector<unsigned> instantiation) const;
 
+		ADDContext &context() const { return *_context; }
 		std::string output() const;
 		const Domain &domain() const;
 
 		double partition() const;
 		double compactation() const;
+		unsigned node_count() const;
 
 		ADDFactor change_variables(std::unordered_map<unsigned,const Variable*> renaming);
 		bool in_scope(const Variable *variable) const;
 
 		ADDFactor sum_out(const Variable *variable) const;
+		ADDFactor sum_out(const std::vector<const Variable*> &variables) const;
+		static ADDFactor sum_product(ADDContext &context, const std::vector<std::shared_ptr<ADDFactor>> &factors, const std::vector<const Variable*> &variables);
 		ADDFactor product(const ADDFactor &f) const;
 		ADDFactor normalize() const;
+
+		// merge leaves whose values lie within epsilon of each other into
+		// their midpoint (APRICODD), keeping zero leaves exact; error is
+		// set to the largest change of a single entry
+		ADDFactor approximate(double epsilon, double &error) const;
 		ADDFactor conditioning(const std::unordered_map<unsigned,unsigned> &evidence) const;
 
+		Factor to_factor() const;
+		std::vector<Node> nodes() const;
+		std::vector<double> values(const Domain &domain) const;
+
 		int dump_dot(std::string filename) const;
 		friend std::ostream &operator<<(std::ostream& o, const ADDFactor &f);
 
 	private:
+		struct TableBit {
+			int index;
+			unsigned variable;
+			unsigned mask;
+		};
+		static std::vector<TableBit> table_bits(ADDContext &context, const Domain &domain);
+		static ADD build(ADDContext &context, const Factor &factor, const std::vector<TableBit> &order, unsigned k, std::vector<unsigned> &codes);
+		static void export_table(DdNode *node, const std::vector<TableBit> &order, unsigned k, std::vector<unsigned> &codes, Factor &factor);
+		static void leaves(DdNode *node, std::unordered_map<DdNode*,bool> &visited, std::vector<double> &values);
+		static uint32_t export_nodes(DdNode *node, std::unordered_map<DdNode*,uint32_t> &numbers, std::vector<Node> &nodes);
+		static ADD replace(ADDContext &context, DdNode *node, const std::unordered_map<double,double> &merged, std::unordered_map<DdNode*,ADD> &cache);
+
+		ADDContext *_context;
 		ADD _dd;
 		std::string _output;
 		std::unique_ptr<Domain> _domain;
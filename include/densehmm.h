@@ -0,0 +1,71 @@
+// Copyright (c) 2015 Thiago Pereira Bueno
+// All Rights Reserved.
+//
+// This file is part of DBN library.
+//
+// DBN is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// DBN is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DBN.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef _DBN_DENSEHMM_H
+#define _DBN_DENSEHMM_H
+
+#include "variable.h"
+#include "domain.h"
+#include "factor.h"
+
+#include <vector>
+#include <unordered_map>
+#include <memory>
+
+namespace dbn {
+
+	// Interface model flattened into an HMM over the joint interface state.
+	// The |S|x|S| transition matrix is precomputed once (row-major, row =
+	// slice t state, column = slice t+1 state) and projection is a blocked
+	// matrix product over a batch of belief vectors.
+	class DenseHMM {
+	public:
+		DenseHMM(
+			const std::vector<const Variable*> &variables,
+			const std::vector<std::shared_ptr<Factor>> &factors,
+			const std::unordered_map<unsigned,const Variable*> &transition,
+			const Factor &sensor_model);
+		DenseHMM(const DenseHMM &) = delete;
+		DenseHMM &operator=(const DenseHMM &) = delete;
+		~DenseHMM();
+
+		static double states(const std::unordered_map<unsigned,const Variable*> &transition);
+
+		// bytes of the transition matrix of an interface of that many states
+		static double matrix_bytes(double states) { return states * states * sizeof(double); }
+
+		unsigned size() const { return _interface.size(); }
+
+		// sensor model interface (see SensorCache)
+		const Domain &domain() const { return _sensor_model.domain(); }
+		std::vector<double> conditioning(const std::unordered_map<unsigned,unsigned> &evidence) const;
+
+		std::vector<double> vectorize(const Factor &factor) const;
+		Factor factor(const std::vector<double> &values) const;
+
+		void project(const double *beliefs, double *projections, unsigned batch = 1) const;
+
+	private:
+		Domain _interface;
+		std::vector<double> _matrix;
+		const Factor &_sensor_model;
+	};
+
+}
+
+#endif
@@ -24,6 +24,7 @@
 #include <vector>
 #include <unordered_map>
 #include <memory>
+#include <cstddef>
 
 namespace dbn {
 
@@ -35,11 +36,15 @@ namespace dbn {
         Domain(const Domain &domain, const std::unordered_map<unsigned,unsigned> &evidence);
         Domain(const Domain &d1, const Domain &d2);
 
-        // Domain &operator=(const Domain &other);
+        Domain &operator=(const Domain &other);
 
         unsigned width() const { return _width; };
         unsigned size()  const { return _size;  };
         std::vector<const Variable*> scope() const { return _scope; };
+        unsigned offset(unsigned i) const { return _offset[i]; };
+
+        // bytes held by the domain, including its own footprint
+        std::size_t memory() const;
 
         const Variable *operator[](unsigned i) const;
         unsigned operator[](const Variable* v) const;
@@ -69,6 +74,10 @@ namespace dbn {
         std::unordered_map<unsigned, unsigned> _var_to_index;
     };
 
+    // position in the linearization of `to` for each instantiation of `from`,
+    // where the scope of `to` is a subset of the scope of `from`
+    std::vector<unsigned> index_map(const Domain &from, const Domain &to);
+
 }
 
 #endif
@@ -0,0 +1,111 @@
+// Copyright (c) 2015 Thiago Pereira Bueno
+// All Rights Reserved.
+//
+// This file is part of DBN library.
+//
+// DBN is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// DBN is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DBN.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef _DBN_EVDDFACTOR_H
+#define _DBN_EVDDFACTOR_H
+
+#include "factor.h"
+#include "domain.h"
+#include "variable.h"
+
+#include <iostream>
+#include <vector>
+#include <unordered_map>
+
+namespace dbn {
+
+	// Factor as a multiplicative edge-valued decision diagram. Every edge
+	// carries a weight and nodes are normalized so that their largest
+	// outgoing weight is 1, hence subfunctions that differ by a scale
+	// factor share a node. Nodes branch on (multi-valued) variables in
+	// the order given by group(); there is a single terminal node.
+	class EVDDFactor {
+	public:
+		struct Node;
+		struct Edge {
+			double weight;
+			const Node *node;
+		};
+		struct Node {
+			unsigned level;
+			std::vector<Edge> children;
+			mutable unsigned refs;
+		};
+
+		// place variables at the next levels of the order, in the given order
+		static void group(const std::vector<const Variable*> &variables);
+
+		// nodes in the unique table, and reclamation of unreferenced ones
+		static unsigned live_nodes();
+		static void collect();
+
+		// forget the variable order of a previous model (once none of its
+		// diagrams is alive), so that ids may be reused with other variables
+		static void reset();
+
+		EVDDFactor(double value = 1.0);
+		EVDDFactor(const Factor &factor);
+		EVDDFactor(const EVDDFactor &f);
+		EVDDFactor(EVDDFactor &&f);
+		~EVDDFactor();
+
+		EVDDFactor &operator=(EVDDFactor &&f);
+		void operator*=(const EVDDFactor &f);
+
+		const Domain &domain() const { return _domain; }
+		bool in_scope(const Variable *variable) const;
+
+		double partition() const;
+		unsigned node_count() const;
+		double compactation() const;
+
+		EVDDFactor change_variables(std::unordered_map<unsigned,const Variable*> renaming) const;
+		EVDDFactor sum_out(const Variable *variable) const;
+		EVDDFactor sum_out(const std::vector<const Variable*> &variables) const;
+		EVDDFactor product(const EVDDFactor &f) const;
+		EVDDFactor normalize() const;
+		EVDDFactor conditioning(const std::unordered_map<unsigned,unsigned> &evidence) const;
+
+		double operator[](const std::unordered_map<unsigned,unsigned> &instantiation) const;
+		std::vector<double> values(const Domain &domain) const;
+
+		friend std::ostream &operator<<(std::ostream &os, const EVDDFactor &f);
+
+	private:
+		EVDDFactor(const Edge &root, const Domain &domain);
+
+		static unsigned level(const Variable *variable);
+		static Edge make(unsigned level, std::vector<Edge> &children);
+		static Edge build(const Factor &factor, const std::vector<unsigned> &order, unsigned k, unsigned position);
+		static Edge multiply(const Edge &e1, const Edge &e2);
+		static Edge add(const Edge &e1, const Edge &e2);
+		static Edge sum_out(const Edge &e, unsigned level, std::unordered_map<const Node*,Edge> &cache);
+		static Edge restrict(const Edge &e, const std::unordered_map<unsigned,unsigned> &values, std::unordered_map<const Node*,Edge> &cache);
+		static Edge relabel(const Edge &e, const std::unordered_map<unsigned,unsigned> &levels, std::unordered_map<const Node*,Edge> &cache);
+		static Edge rename(const Edge &e, const std::unordered_map<unsigned,unsigned> &levels, std::unordered_map<const Node*,Edge> &cache);
+
+		static std::unordered_map<unsigned,unsigned> levels;
+		static std::vector<const Variable*> variables;
+
+		Edge _root;
+		Domain _domain;
+	};
+
+}
+
+#endif
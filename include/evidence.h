@@ -0,0 +1,78 @@
+// Copyright (c) 2015 Thiago Pereira Bueno
+// All Rights Reserved.
+//
+// This file is part of DBN library.
+//
+// DBN is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// DBN is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DBN.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef _DBN_EVIDENCE_H
+#define _DBN_EVIDENCE_H
+
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+#include <cstddef>
+
+namespace dbn {
+
+	// Observations of T timesteps over a fixed set of E evidence variables,
+	// stored densely as one array of small integers per variable (structure
+	// of arrays). MISSING marks a variable unobserved at a timestep.
+	class Evidence {
+	public:
+		typedef uint16_t value_type;
+		static const value_type MISSING = 0xFFFF;
+
+		Evidence() { }
+		Evidence(const std::vector<unsigned> &variables, unsigned timesteps = 0);
+
+		unsigned timesteps() const { return _values.empty() ? 0 : _values[0].size(); }
+		unsigned width() const { return _variables.size(); }
+		const std::vector<unsigned> &variables() const { return _variables; }
+
+		// column of an evidence variable, -1 for other variables
+		int column(unsigned id) const { return id < _columns.size() ? _columns[id] : -1; }
+
+		value_type value(unsigned t, unsigned column) const { return _values[column][t]; }
+		void set(unsigned t, unsigned column, value_type value) { _values[column][t] = value; }
+
+		// new timesteps are unobserved
+		void resize(unsigned timesteps);
+
+		// observed values of timestep t as (variable id -> value)
+		std::unordered_map<unsigned,unsigned> observed(unsigned t) const;
+
+		std::size_t memory() const;
+
+	private:
+		std::vector<unsigned> _variables;
+		std::vector<int> _columns;
+		std::vector<std::vector<value_type>> _values;
+	};
+
+	// one timestep of an Evidence table
+	struct EvidenceRow {
+		const Evidence *evidence;
+		unsigned t;
+
+		unsigned width() const { return evidence->width(); }
+		unsigned variable(unsigned column) const { return evidence->variables()[column]; }
+		Evidence::value_type value(unsigned column) const { return evidence->value(t, column); }
+		int column(unsigned id) const { return evidence->column(id); }
+		std::unordered_map<unsigned,unsigned> observed() const { return evidence->observed(t); }
+	};
+
+}
+
+#endif
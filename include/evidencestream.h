@@ -0,0 +1,91 @@
+// Copyright (c) 2015 Thiago Pereira Bueno
+// All Rights Reserved.
+//
+// This file is part of DBN library.
+//
+// DBN is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// DBN is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DBN.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef _DBN_EVIDENCESTREAM_H
+#define _DBN_EVIDENCESTREAM_H
+
+#include "evidence.h"
+#include "variable.h"
+
+#include <vector>
+#include <string>
+#include <set>
+
+namespace dbn {
+
+	// Incremental reader of row-major evidence (.duai.stream):
+	//
+	//   DSTREAM
+	//   <E> [list of E evidence variable ids]
+	//   <SV> [list of state variables to display]
+	//   [E values of timestep 1]
+	//   [E values of timestep 2]
+	//   ...
+	//
+	// A value '*' leaves the variable unobserved at that timestep. Input is
+	// read in fixed size chunks from a file, a pipe or stdin ("-"), so only
+	// the current timestep is ever held in memory.
+	class EvidenceStream {
+	public:
+		EvidenceStream(const char *filename);
+		EvidenceStream(const EvidenceStream &) = delete;
+		EvidenceStream &operator=(const EvidenceStream &) = delete;
+		~EvidenceStream();
+
+		bool is_open() const { return _fd >= 0 && _valid; }
+		const std::vector<unsigned> &variables() const { return _variables; }
+		const std::set<unsigned> &state_variables() const { return _state_variables; }
+
+		// checks the evidence variables against the model (variables by
+		// id), whose cardinalities then bound the values of every record
+		bool bind(const std::vector<const Variable*> &variables);
+
+		// evidence of the next timestep, valid until the following call;
+		// false at the end of the stream, on a truncated record or on a
+		// value out of the range of its variable
+		bool next(EvidenceRow &row);
+		unsigned timesteps() const { return _timesteps; }
+
+	private:
+		enum Token { VALUE, MISSING, WORD, END };
+		Token next_token(unsigned &value);
+		bool fill();
+
+		int _fd;
+		bool _close;
+		bool _valid;
+		std::vector<char> _buffer;
+		std::size_t _position;
+		std::size_t _size;
+		std::string _word;
+		unsigned _line;
+		unsigned _token_line;
+
+		std::vector<unsigned> _variables;
+		std::vector<unsigned> _cardinalities;
+		std::set<unsigned> _state_variables;
+		Evidence _window;
+		unsigned _timesteps;
+	};
+
+	// true if the file starts with the DSTREAM header
+	bool is_evidence_stream(const char *filename);
+
+}
+
+#endif
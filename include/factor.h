@@ -23,6 +23,7 @@
 
 #include <vector>
 #include <memory>
+#include <cstddef>
 
 namespace dbn {
 
@@ -30,9 +31,13 @@ namespace dbn {
     public:
         Factor(Domain *domain);
         Factor(Domain *domain, double value);
+        // read-only view of values owned by storage (e.g. a mapped file),
+        // copied into the factor on the first write
+        Factor(Domain *domain, const double *values, std::shared_ptr<const void> storage, double partition);
         Factor(double value = 1.0);
         Factor(const Factor &f);
         Factor(Factor &&f);
+        ~Factor();
 
         Factor &operator=(Factor &&f);
         Factor operator*(const Factor &f);
@@ -43,6 +48,9 @@ namespace dbn {
         unsigned width()       const { return _domain->width(); }
         double partition()     const { return _partition; }
 
+        // bytes held by the factor and its domain (views count as empty)
+        std::size_t memory() const;
+
         void partition(double p) { _partition = p; }
 
         const double &operator[](unsigned i) const;
@@ -58,12 +66,21 @@ namespace dbn {
         Factor normalize() const;
         Factor conditioning(const std::unordered_map<unsigned,unsigned> &evidence) const;
 
+        // values for all instantiations of domain (same scope, any order)
+        std::vector<double> values(const Domain &domain) const;
+
         friend std::ostream &operator<<(std::ostream &os, const Factor &f);
 
     private:
+        double *writable_values();
+        void account();
+
         std::unique_ptr<Domain> _domain;
         std::vector<double> _values;
         double _partition;
+        const double *_view;
+        std::shared_ptr<const void> _storage;
+        std::size_t _bytes;
     };
 
 }
@@ -0,0 +1,71 @@
+// Copyright (c) 2015 Thiago Pereira Bueno
+// All Rights Reserved.
+//
+// This file is part of DBN library.
+//
+// DBN is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// DBN is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DBN.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef _DBN_GENERATOR_H
+#define _DBN_GENERATOR_H
+
+#include "variable.h"
+#include "factor.h"
+#include "evidence.h"
+
+#include <vector>
+#include <unordered_map>
+#include <set>
+#include <memory>
+#include <random>
+
+namespace dbn {
+
+	// A DBN held in memory, as read_uai_model lays it out: variable i is
+	// the child (first variable) of factor i.
+	struct Model {
+		std::vector<std::unique_ptr<Variable>> variables;
+		std::vector<std::shared_ptr<Factor>> factors;
+		std::set<unsigned> prior, interface, sensor, internals, forward_interface;
+		std::unordered_map<unsigned,const Variable*> transition;
+
+		// variables reported by the filters (the current state variables)
+		std::set<unsigned> state_variables;
+	};
+
+	// Digital circuit with persistent gate faults (port of gendc.py): the
+	// inputs and the output of the circuit are observed, and each of the
+	// health variables fails one or more of the gates.
+	void generate_dc(Model &model, unsigned inputs, unsigned gates, unsigned health, std::mt19937 &generator);
+
+	// Random DBN: each of the interface state variables depends on a window
+	// of parents consecutive state variables of the previous slice (so the
+	// 2TBN has treewidth about parents), and sensor i observes state
+	// variable i mod interface. A fraction sparsity of CPT entries is zero.
+	struct RandomDBN {
+		unsigned interface = 4;
+		unsigned parents = 2;
+		unsigned sensors = 4;
+		unsigned cardinality = 2;
+		double sparsity = 0.0;
+	};
+
+	void generate_random_dbn(Model &model, const RandomDBN &parameters, std::mt19937 &generator);
+
+	// observations of the sensor variables along a trajectory sampled
+	// forward from the model
+	Evidence sample_observations(const Model &model, unsigned timesteps, std::mt19937 &generator);
+
+}
+
+#endif
@@ -32,15 +32,33 @@ namespace dbn {
 
 	class Graph {
 	public:
-		Graph(const std::vector<std::shared_ptr<Factor>> &factors);
-		std::vector<const Variable*> ordering(const std::vector<const Variable*> &variables);
+		enum Heuristic { MIN_FILL, MIN_DEGREE, WEIGHTED_MIN_FILL };
+
+		Graph(const std::vector<std::vector<const Variable*>> &scopes);
+
+		template<class T>
+		Graph(const std::vector<std::shared_ptr<T>> &factors) : _induced_width(0) {
+			for (auto const &pf : factors) {
+				add_clique(pf->domain().scope());
+			}
+		}
+
+		std::vector<const Variable*> ordering(const std::vector<const Variable*> &variables, Heuristic heuristic = MIN_FILL);
+		unsigned induced_width() const { return _induced_width; }
+		unsigned induced_width(const std::vector<const Variable*> &ordering) const;
+
+		void add_clique(const std::vector<const Variable*> &variables);
+		std::vector<std::vector<const Variable*>> cliques(const std::vector<const Variable*> &ordering) const;
 
 		friend std::ostream &operator<<(std::ostream &os, const Graph &g);
 
 	private:
-		unsigned min_fill(std::vector<const Variable*> &variables, std::unordered_set<const Variable*> &processed);
+		typedef std::unordered_map<const Variable*,std::unordered_set<const Variable*>> Adjacency;
+
+		static double score(const Adjacency &adj, const Variable *variable, Heuristic heuristic);
 
-		std::unordered_map<const Variable*,std::unordered_set<const Variable*>> _adj;
+		Adjacency _adj;
+		unsigned _induced_width;
 	};
 
 }
@@ -22,33 +22,120 @@
 #include "variable.h"
 #include "factor.h"
 #include "addfactor.h"
+#include "evddfactor.h"
+#include "evidence.h"
+#include "graph.h"
+#include "planner.h"
 
 #include <vector>
 #include <set>
 #include <memory>
+#include <functional>
 
 namespace dbn {
 
+	// configuration shared by all filtering runs
+	void set_elimination_heuristic(Graph::Heuristic heuristic);
+	void set_sensor_cache(unsigned capacity, bool prewarm = false);
+	void set_dense_limit(unsigned states);
+	void set_reordering_threshold(long nodes);
+	void set_approximation(double epsilon);
+
+	// State of one filtering run, passed by the caller: the cost-based
+	// planner its orderings are refined by, if any, and the statistics the
+	// run fills in. Concurrent runs use separate instances.
+	struct FilteringRun {
+		Planner *planner = nullptr;
+		unsigned induced_width = 0;
+		unsigned sensor_cache_hits = 0;
+		unsigned sensor_cache_misses = 0;
+		bool dense_fast_path = false;
+		// sum over the steps of an ADD run of the largest leaf merge error
+		// of a single entry (L-infinity, before renormalization)
+		double approximation_error = 0.0;
+	};
+
+	// evidence of the next timestep, false when the stream ends
+	typedef std::function<bool(EvidenceRow&)> EvidenceSource;
+
+	// batch observations as an evidence source, row by row
+	EvidenceSource replay(const Evidence &observations);
+
+	// receives the belief state of each timestep, in order
+	template<class T>
+	using EstimateSink = std::function<void(const T&)>;
+
 	std::vector<std::shared_ptr<Factor>> unrolled_filtering(
 		std::vector<const Variable*> variables, std::vector<std::shared_ptr<Factor>> &factors,
 		std::set<unsigned> &prior, std::set<unsigned> &sensor, std::set<unsigned> &internals,
 		std::unordered_map<unsigned,const Variable*> &transition,
-		std::vector<std::unordered_map<unsigned,unsigned>> &observations,
-		bool verbose = false
+		const Evidence &observations,
+		bool verbose = false,
+		FilteringRun *run = nullptr
 	);
 
 	std::vector<std::shared_ptr<Factor>> filtering(
 		std::vector<const Variable*> &variables, std::vector<std::shared_ptr<Factor>> &factors,
 		std::set<unsigned> &prior, std::set<unsigned> &sensor, std::set<unsigned> &internals,
-		std::unordered_map<unsigned,const Variable*> &transition,
-		std::vector<std::unordered_map<unsigned,unsigned>> &observations
+		std::unordered_map<unsigned,const Variable*> &transition, std::set<unsigned> &forward_interface,
+		const Evidence &observations,
+		FilteringRun *run = nullptr
+	);
+
+	unsigned filtering(
+		std::vector<const Variable*> &variables, std::vector<std::shared_ptr<Factor>> &factors,
+		std::set<unsigned> &prior, std::set<unsigned> &sensor, std::set<unsigned> &internals,
+		std::unordered_map<unsigned,const Variable*> &transition, std::set<unsigned> &forward_interface,
+		EvidenceSource next, EstimateSink<Factor> estimate,
+		FilteringRun *run = nullptr
 	);
 
 	std::vector<std::shared_ptr<ADDFactor>> filtering(
 		std::vector<const Variable*> &variables, std::vector<std::shared_ptr<ADDFactor>> &factors,
 		std::set<unsigned> &prior, std::set<unsigned> &sensor, std::set<unsigned> &internals,
+		std::unordered_map<unsigned,const Variable*> &transition, std::set<unsigned> &forward_interface,
+		const Evidence &observations,
+		FilteringRun *run = nullptr
+	);
+
+	unsigned filtering(
+		std::vector<const Variable*> &variables, std::vector<std::shared_ptr<ADDFactor>> &factors,
+		std::set<unsigned> &prior, std::set<unsigned> &sensor, std::set<unsigned> &internals,
+		std::unordered_map<unsigned,const Variable*> &transition, std::set<unsigned> &forward_interface,
+		EvidenceSource next, EstimateSink<ADDFactor> estimate,
+		FilteringRun *run = nullptr
+	);
+
+	std::vector<std::shared_ptr<EVDDFactor>> filtering(
+		std::vector<const Variable*> &variables, std::vector<std::shared_ptr<EVDDFactor>> &factors,
+		std::set<unsigned> &prior, std::set<unsigned> &sensor, std::set<unsigned> &internals,
+		std::unordered_map<unsigned,const Variable*> &transition, std::set<unsigned> &forward_interface,
+		const Evidence &observations,
+		FilteringRun *run = nullptr
+	);
+
+	unsigned filtering(
+		std::vector<const Variable*> &variables, std::vector<std::shared_ptr<EVDDFactor>> &factors,
+		std::set<unsigned> &prior, std::set<unsigned> &sensor, std::set<unsigned> &internals,
+		std::unordered_map<unsigned,const Variable*> &transition, std::set<unsigned> &forward_interface,
+		EvidenceSource next, EstimateSink<EVDDFactor> estimate,
+		FilteringRun *run = nullptr
+	);
+
+	std::vector<std::shared_ptr<Factor>> junction_tree_filtering(
+		std::vector<const Variable*> &variables, std::vector<std::shared_ptr<Factor>> &factors,
+		std::set<unsigned> &prior, std::set<unsigned> &sensor, std::set<unsigned> &internals,
+		std::unordered_map<unsigned,const Variable*> &transition,
+		const Evidence &observations,
+		FilteringRun *run = nullptr
+	);
+
+	unsigned junction_tree_filtering(
+		std::vector<const Variable*> &variables, std::vector<std::shared_ptr<Factor>> &factors,
+		std::set<unsigned> &prior, std::set<unsigned> &sensor, std::set<unsigned> &internals,
 		std::unordered_map<unsigned,const Variable*> &transition,
-		std::vector<std::unordered_map<unsigned,unsigned>> &observations
+		EvidenceSource next, EstimateSink<Factor> estimate,
+		FilteringRun *run = nullptr
 	);
 
 }
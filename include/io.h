@@ -22,6 +22,8 @@
 #include "variable.h"
 #include "factor.h"
 #include "addfactor.h"
+#include "evddfactor.h"
+#include "evidence.h"
 
 #include <vector>
 #include <unordered_map>
@@ -34,14 +36,43 @@ namespace dbn {
 		const char *filename,
 		unsigned &order,
 		std::vector<std::unique_ptr<Variable>> &variables,
-		std::vector<std::shared_ptr<Factor>> &factors, std::vector<std::shared_ptr<ADDFactor>> &addfactors,
+		std::vector<std::shared_ptr<Factor>> &factors,
 		std::set<unsigned> &prior, std::set<unsigned> &interface, std::set<unsigned> &sensor, std::set<unsigned> &internals,
-		std::unordered_map<unsigned,const Variable*> &transition
+		std::unordered_map<unsigned,const Variable*> &transition, std::set<unsigned> &forward_interface
 	);
 
+	// variables neither in the interface nor observed
+	void read_internals_model(
+		std::vector<std::unique_ptr<Variable>> &variables,
+		unsigned &internals_order,
+		std::set<unsigned> &interface, std::set<unsigned> &sensor, std::set<unsigned> &internals);
+
+	// slice t variables with children in slice t+1
+	void read_forward_interface(
+		std::vector<std::shared_ptr<Factor>> &factors,
+		std::unordered_map<unsigned,const Variable*> &transition,
+		std::set<unsigned> &forward_interface);
+
+	// decision diagram variable order: interface pairs, each followed by
+	// the sensor and internal variables whose parents are already placed
+	std::vector<std::vector<const Variable*>> variable_groups(
+		const std::vector<std::shared_ptr<Factor>> &factors, const std::unordered_map<unsigned,const Variable*> &transition);
+
+	// ADDs are built on demand, only for the methods that need them
+	void read_addfactors(
+		ADDContext &context,
+		const std::vector<std::shared_ptr<Factor>> &factors, const std::unordered_map<unsigned,const Variable*> &transition,
+		std::vector<std::shared_ptr<ADDFactor>> &addfactors);
+
+	void read_evddfactors(
+		const std::vector<std::shared_ptr<Factor>> &factors, const std::unordered_map<unsigned,const Variable*> &transition,
+		std::vector<std::shared_ptr<EVDDFactor>> &evddfactors);
+
+	// values are checked against the cardinalities of the model variables
 	int read_observations(
 		const char *filename,
-		std::vector<std::unordered_map<unsigned,unsigned>> &observations,
+		const std::vector<std::unique_ptr<Variable>> &variables,
+		Evidence &observations,
 		std::set<unsigned> &state_variables
 	);
 
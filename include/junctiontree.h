@@ -0,0 +1,103 @@
+// Copyright (c) 2015 Thiago Pereira Bueno
+// All Rights Reserved.
+//
+// This file is part of DBN library.
+//
+// DBN is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// DBN is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DBN.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef _DBN_JUNCTIONTREE_H
+#define _DBN_JUNCTIONTREE_H
+
+#include "variable.h"
+#include "domain.h"
+#include "factor.h"
+#include "graph.h"
+#include "evidence.h"
+
+#include <vector>
+#include <set>
+#include <unordered_map>
+#include <memory>
+#include <iostream>
+#include <cstddef>
+
+namespace dbn {
+
+	// 1.5-slice junction tree (Murphy, 2002) over the interface variables of
+	// slice t-1 and all variables of slice t. The clique tree, its separators,
+	// the message schedule and the clique table layouts are built once; each
+	// filtering step is a collect pass towards the clique holding the slice t
+	// interface on preallocated tables.
+	class JunctionTree {
+	public:
+		JunctionTree(
+			const std::vector<const Variable*> &variables, std::vector<std::shared_ptr<Factor>> &factors,
+			const std::set<unsigned> &sensor, const std::set<unsigned> &internals,
+			const std::unordered_map<unsigned,const Variable*> &transition,
+			Graph::Heuristic heuristic = Graph::MIN_FILL);
+		JunctionTree(const JunctionTree &) = delete;
+		JunctionTree &operator=(const JunctionTree &) = delete;
+		~JunctionTree();
+
+		const Domain &interface() const { return _interface; }
+
+		unsigned cliques()  const { return _cliques.size(); }
+		unsigned max_clique_size() const;
+		unsigned induced_width() const { return _induced_width; }
+
+		Factor step(const Factor &forward, const EvidenceRow &evidence);
+
+		friend std::ostream &operator<<(std::ostream &os, const JunctionTree &jt);
+
+	private:
+		struct Clique {
+			Domain domain;
+			std::vector<double> potential;
+			int parent;
+
+			// layout for the current set of observed variables
+			Domain reduced;
+			std::vector<unsigned> gather;
+			std::vector<std::pair<unsigned,unsigned>> strides;
+			std::vector<double> table;
+
+			// message to parent clique
+			std::vector<unsigned> projection;
+			std::vector<unsigned> extension;
+			std::vector<double> message;
+		};
+
+		void prepare(const std::unordered_map<unsigned,unsigned> &evidence);
+		void resize(std::vector<double> &buffer, unsigned size, double value = 0.0);
+
+		std::vector<Clique> _cliques;
+		std::vector<unsigned> _schedule;
+		unsigned _root;
+		unsigned _in;
+		unsigned _induced_width;
+
+		Domain _interface;
+		Domain _next_interface;
+
+		std::vector<unsigned> _observed;
+		std::vector<unsigned> _forward_map;
+		std::vector<unsigned> _root_map;
+
+		// bytes of the clique buffers, held in the MemoryAccountant
+		std::size_t _bytes;
+	};
+
+}
+
+#endif
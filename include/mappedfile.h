@@ -0,0 +1,51 @@
+// Copyright (c) 2015 Thiago Pereira Bueno
+// All Rights Reserved.
+//
+// This file is part of DBN library.
+//
+// DBN is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// DBN is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DBN.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef _DBN_MAPPEDFILE_H
+#define _DBN_MAPPEDFILE_H
+
+#include <vector>
+#include <cstddef>
+
+namespace dbn {
+
+	// Read-only memory image of a whole file: mapped when possible, read
+	// into a buffer otherwise (pipes, empty files, no mmap support)
+	class MappedFile {
+	public:
+		MappedFile(const char *filename, bool sequential = true);
+		MappedFile(const MappedFile &) = delete;
+		MappedFile &operator=(const MappedFile &) = delete;
+		~MappedFile();
+
+		bool is_open() const { return _open; }
+		const char *begin() const { return _data; }
+		const char *end() const { return _data + _size; }
+		std::size_t size() const { return _size; }
+
+	private:
+		const char *_data;
+		std::size_t _size;
+		bool _mapped;
+		bool _open;
+		std::vector<char> _buffer;
+	};
+
+}
+
+#endif
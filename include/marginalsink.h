@@ -0,0 +1,61 @@
+// Copyright (c) 2015 Thiago Pereira Bueno
+// All Rights Reserved.
+//
+// This file is part of DBN library.
+//
+// DBN is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// DBN is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DBN.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef _DBN_MARGINALSINK_H
+#define _DBN_MARGINALSINK_H
+
+#include "domain.h"
+#include "variable.h"
+
+#include <string>
+#include <vector>
+
+namespace dbn {
+
+	// Destination of the state marginals of each timestep, written as soon
+	// as they are computed. Values follow the linearization of the state
+	// domain; records carry the filtering method and the timestep.
+	//
+	//   csv:    header "method,t,<instantiation>...", then one line per record
+	//   binary: "DBNM", uint32 version, width, size, width x (uint32 id,
+	//           uint32 cardinality), then records of uint32 method,
+	//           uint32 t and size float32 values
+	class MarginalSink {
+	public:
+		virtual ~MarginalSink() { }
+		virtual void write(unsigned method, unsigned t, const std::vector<double> &marginal) = 0;
+
+		// format "csv" or "binary", filename "-" for stdout; nullptr on error
+		static MarginalSink *open(const std::string &filename, const std::string &format, const Domain &domain);
+	};
+
+	// projection of a belief state onto domain (a subset of its scope)
+	template<class T>
+	std::vector<double> marginal(const T &belief_state, const Domain &domain) {
+		T f = belief_state;
+		for (auto pv : belief_state.domain().scope()) {
+			if (!domain.in_scope(pv)) {
+				f = f.sum_out(pv);
+			}
+		}
+		return f.values(domain);
+	}
+
+}
+
+#endif
@@ -0,0 +1,93 @@
+// Copyright (c) 2015 Thiago Pereira Bueno
+// All Rights Reserved.
+//
+// This file is part of DBN library.
+//
+// DBN is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// DBN is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DBN.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef _DBN_MEMORYACCOUNTANT_H
+#define _DBN_MEMORYACCOUNTANT_H
+
+#include <iostream>
+#include <string>
+#include <stdexcept>
+#include <atomic>
+#include <cstddef>
+
+namespace dbn {
+
+	// Process-wide count of the bytes held by factor tables, junction tree
+	// and dense HMM buffers and decision diagram managers, with an optional
+	// budget (--mem-limit). Tables are checked against the budget before
+	// they are allocated; a CUDD manager is capped to the remaining budget
+	// (see ADDContext) and its memory is sampled after each step.
+	class MemoryAccountant {
+	public:
+		static void allocate(std::size_t bytes);
+		static void release(std::size_t bytes);
+
+		// whether bytes more fit the limit; check() throws
+		// MemoryLimitExceeded when they do not
+		static bool available(double bytes) { return !_limit || _current + bytes <= _limit; }
+		static void check(double bytes, const char *what);
+
+		// 0 disables the limit
+		static void limit(std::size_t bytes) { _limit = bytes; }
+		static std::size_t limit() { return _limit; }
+
+		static std::size_t current() { return _current; }
+		static std::size_t peak() { return _peak; }
+		static void reset_peak() { _peak = _current.load(); }
+
+	private:
+		static std::atomic<std::size_t> _current;
+		static std::atomic<std::size_t> _peak;
+		static std::size_t _limit;
+	};
+
+	// an allocation (of the predicted size) that does not fit the budget;
+	// counters are taken when it is thrown
+	class MemoryLimitExceeded : public std::runtime_error {
+	public:
+		MemoryLimitExceeded(const std::string &what, double requested);
+
+		double requested() const { return _requested; }
+		std::size_t current() const { return _current; }
+		std::size_t peak() const { return _peak; }
+		std::size_t limit() const { return _limit; }
+
+		void report(std::ostream &os) const;
+
+	private:
+		double _requested;
+		std::size_t _current;
+		std::size_t _peak;
+		std::size_t _limit;
+	};
+
+	inline void MemoryAccountant::allocate(std::size_t bytes) {
+		std::size_t current = (_current += bytes);
+		std::size_t peak = _peak;
+		while (current > peak && !_peak.compare_exchange_weak(peak, current)) { }
+	}
+
+	inline void MemoryAccountant::release(std::size_t bytes) { _current -= bytes; }
+
+	inline void MemoryAccountant::check(double bytes, const char *what) {
+		if (!available(bytes)) throw MemoryLimitExceeded(what, bytes);
+	}
+
+}
+
+#endif
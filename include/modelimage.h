@@ -0,0 +1,137 @@
+// Copyright (c) 2015 Thiago Pereira Bueno
+// All Rights Reserved.
+//
+// This file is part of DBN library.
+//
+// DBN is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// DBN is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DBN.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef _DBN_MODELIMAGE_H
+#define _DBN_MODELIMAGE_H
+
+#include "variable.h"
+#include "factor.h"
+#include "addfactor.h"
+#include "addcontext.h"
+#include "mappedfile.h"
+
+#include <vector>
+#include <unordered_map>
+#include <set>
+#include <memory>
+#include <cstdint>
+
+namespace dbn {
+
+	// Compiled model (.dbnb): the parsed .duai model as a binary image that
+	// is mapped and used in place. Integers are in native byte order and
+	// every section starts at a multiple of IMAGE_ALIGNMENT, as does each
+	// block of CPT values; factors loaded from an image read their values
+	// directly from the mapping.
+	//
+	// Sections (element type):
+	//   CARDINALITIES       uint32 per variable
+	//   TRANSITIONS         uint32 pairs (current, next) of interface variables
+	//   SENSOR, INTERNALS,
+	//   FORWARD_INTERFACE   uint32 variable ids
+	//   FACTORS             ImageFactor per variable, in variable order
+	//   SCOPES, STRIDES     uint32 scope and domain offsets of all factors
+	//   VALUES              double
+	//   GROUPS              uint32 runs [size, ids...] of the ADD/EVDD order
+	//   ADD_ENCODING        int32 runs [id, nbits, indices...] (optional)
+	//   ADD_FACTORS         ImageADD per variable (optional)
+	//   ADD_NODES           ADDFactor::Node (optional)
+	enum ImageSection {
+		CARDINALITIES, TRANSITIONS, SENSOR, INTERNALS, FORWARD_INTERFACE,
+		FACTORS, SCOPES, STRIDES, VALUES, GROUPS,
+		ADD_ENCODING, ADD_FACTORS, ADD_NODES,
+		IMAGE_SECTIONS
+	};
+
+	const uint32_t IMAGE_VERSION = 1;
+	const uint32_t IMAGE_BYTE_ORDER = 0x01020304;
+	const uint64_t IMAGE_ALIGNMENT = 64;
+
+	struct ImageHeader {
+		char magic[8];
+		uint32_t version;
+		uint32_t byte_order;
+		struct {
+			uint64_t offset;
+			uint64_t count;
+		} sections[IMAGE_SECTIONS];
+	};
+
+	struct ImageFactor {
+		uint32_t width;
+		uint32_t scope;      // first entry in SCOPES and STRIDES
+		uint64_t size;
+		uint64_t values;     // first entry in VALUES
+		double partition;
+	};
+
+	struct ImageADD {
+		uint64_t first;      // first entry in ADD_NODES, the root is last
+		uint64_t count;
+	};
+
+	bool is_model_image(const char *filename);
+
+	// compile a parsed model, with the ADDs of its factors if adds is set
+	int write_model_image(
+		const char *filename,
+		const std::vector<std::unique_ptr<Variable>> &variables,
+		const std::vector<std::shared_ptr<Factor>> &factors,
+		const std::set<unsigned> &sensor, const std::set<unsigned> &internals,
+		const std::unordered_map<unsigned,const Variable*> &transition, const std::set<unsigned> &forward_interface,
+		bool adds
+	);
+
+	class ModelImage {
+	public:
+		ModelImage(const char *filename);
+
+		bool is_open() const { return _header != nullptr; }
+		bool has_addfactors() const;
+
+		// same outputs as read_uai_model
+		int read_model(
+			unsigned &order,
+			std::vector<std::unique_ptr<Variable>> &variables,
+			std::vector<std::shared_ptr<Factor>> &factors,
+			std::set<unsigned> &prior, std::set<unsigned> &interface, std::set<unsigned> &sensor, std::set<unsigned> &internals,
+			std::unordered_map<unsigned,const Variable*> &transition, std::set<unsigned> &forward_interface
+		) const;
+
+		// rebuild the compiled ADDs of factors (as returned by read_model)
+		int read_addfactors(
+			ADDContext &context,
+			const std::vector<std::unique_ptr<Variable>> &variables,
+			const std::vector<std::shared_ptr<Factor>> &factors,
+			std::vector<std::shared_ptr<ADDFactor>> &addfactors
+		) const;
+
+	private:
+		template<class T>
+		const T *section(ImageSection s) const {
+			return reinterpret_cast<const T*>(_file->begin() + _header->sections[s].offset);
+		}
+		uint64_t count(ImageSection s) const { return _header->sections[s].count; }
+
+		std::shared_ptr<MappedFile> _file;
+		const ImageHeader *_header;
+	};
+
+}
+
+#endif
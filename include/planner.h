@@ -0,0 +1,83 @@
+// Copyright (c) 2015 Thiago Pereira Bueno
+// All Rights Reserved.
+//
+// This file is part of DBN library.
+//
+// DBN is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// DBN is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DBN.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef _DBN_PLANNER_H
+#define _DBN_PLANNER_H
+
+#include "variable.h"
+#include "factor.h"
+#include "graph.h"
+
+#include <vector>
+#include <set>
+#include <unordered_map>
+#include <string>
+#include <memory>
+#include <cstdint>
+
+namespace dbn {
+
+	// Cost-based elimination planner. Plans are scored by the estimated
+	// number of floating point operations of the bucket products and
+	// sum-outs (ties broken by peak memory of intermediate tables) and are
+	// persisted to a cache file keyed by a hash of the model structure and
+	// the heuristic of the seed orderings; the file is written once, when
+	// the planner is destroyed, and only if a new plan was computed.
+	class Planner {
+	public:
+		struct Plan {
+			std::vector<unsigned> ordering;
+			double flops;
+			double memory;
+		};
+
+		Planner(uint64_t key, const std::string &cache_dir = "");
+		~Planner();
+
+		std::vector<const Variable*> ordering(
+			const std::string &name,
+			const std::vector<const Variable*> &variables,
+			const std::vector<std::vector<const Variable*>> &scopes,
+			const std::vector<const Variable*> &seed);
+
+		const Plan &plan(const std::string &name) const { return _plans.at(name); }
+
+		unsigned hits()   const { return _hits;   }
+		unsigned misses() const { return _misses; }
+
+		static Plan evaluate(const std::vector<const Variable*> &ordering, const std::vector<std::vector<const Variable*>> &scopes);
+
+	private:
+		void save() const;
+
+		uint64_t _key;
+		std::string _filename;
+		std::unordered_map<std::string,Plan> _plans;
+		bool _changed;
+		unsigned _hits;
+		unsigned _misses;
+	};
+
+	uint64_t structure_hash(
+		const std::vector<std::unique_ptr<Variable>> &variables, const std::vector<std::shared_ptr<Factor>> &factors,
+		const std::set<unsigned> &sensor, const std::unordered_map<unsigned,const Variable*> &transition,
+		Graph::Heuristic heuristic);
+
+}
+
+#endif
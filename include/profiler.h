@@ -0,0 +1,130 @@
+// Copyright (c) 2015 Thiago Pereira Bueno
+// All Rights Reserved.
+//
+// This file is part of DBN library.
+//
+// DBN is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// DBN is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DBN.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef _DBN_PROFILER_H
+#define _DBN_PROFILER_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+
+namespace dbn {
+
+	struct ProfileCounters;
+	struct Profile;
+
+	// Profiling of filtering runs (-p), switched on for the whole process.
+	// When disabled, the instrumented code only tests enabled(). Counters
+	// are kept per thread, so sessions on separate threads are profiled
+	// apart and collect() returns those of the calling thread.
+	class Profiler {
+	public:
+		enum Phase { MODEL_LOAD, SENSOR_MODEL, PROJECTION, CONDITIONING, UPDATE, NORMALIZATION, OUTPUT, PHASES };
+
+		static bool enabled() { return _enabled; }
+		static void enable(bool on = true) { _enabled = on; }
+
+		static void time(Phase phase, double ms);
+		static void product(double entries, double result);
+		static void sum_out(double entries, double result);
+		static void touch(double entries);
+		static void allocation();
+
+		// close the current section as setup work or as one timestep
+		static void end_setup();
+		static void end_step();
+
+		// everything recorded since the last collect()
+		static Profile collect();
+
+	private:
+		static bool _enabled;
+		static thread_local ProfileCounters _current;
+		static thread_local Profile _profile;
+	};
+
+	// Time per phase (ms) and factor operation counters. Entries are the
+	// table entries (decision diagram nodes) read or written; max_factor is
+	// the largest intermediate result and allocations count factor tables.
+	struct ProfileCounters {
+		double time[Profiler::PHASES] = {};
+		unsigned long products = 0;
+		unsigned long sum_outs = 0;
+		double entries = 0.0;
+		double max_factor = 0.0;
+		unsigned long allocations = 0;
+
+		void add(const ProfileCounters &counters);
+		void write_json(std::ostream &os) const;
+	};
+
+	// counters of the work done outside the timesteps, of each timestep
+	// and their sum
+	struct Profile {
+		ProfileCounters setup;
+		std::vector<ProfileCounters> steps;
+		ProfileCounters total;
+
+		void write_json(std::ostream &os, const std::string &indent = "") const;
+	};
+
+	inline void Profiler::time(Phase phase, double ms) { _current.time[phase] += ms; }
+	inline void Profiler::touch(double entries) { _current.entries += entries; }
+	inline void Profiler::allocation() { _current.allocations++; }
+
+	// adds the wall time of its lifetime to a phase, when profiling; next()
+	// switches to another phase and stop() ends the timing early
+	class ScopedPhase {
+	public:
+		ScopedPhase(Profiler::Phase phase) : _phase(phase), _enabled(Profiler::enabled()), _running(false) {
+			start();
+		}
+		~ScopedPhase() { stop(); }
+
+		void next(Profiler::Phase phase) {
+			stop();
+			_phase = phase;
+			start();
+		}
+
+		void stop() {
+			if (_running) {
+				auto end = std::chrono::steady_clock::now();
+				Profiler::time(_phase, std::chrono::duration<double, std::milli>(end - _start).count());
+				_running = false;
+			}
+		}
+
+	private:
+		void start() {
+			if (_enabled) {
+				_start = std::chrono::steady_clock::now();
+				_running = true;
+			}
+		}
+
+		Profiler::Phase _phase;
+		bool _enabled;
+		bool _running;
+		std::chrono::steady_clock::time_point _start;
+	};
+
+}
+
+#endif
@@ -0,0 +1,175 @@
+// Copyright (c) 2015 Thiago Pereira Bueno
+// All Rights Reserved.
+//
+// This file is part of DBN library.
+//
+// DBN is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// DBN is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DBN.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef _DBN_SENSORCACHE_H
+#define _DBN_SENSORCACHE_H
+
+#include "variable.h"
+#include "evidence.h"
+
+#include <vector>
+#include <list>
+#include <set>
+#include <unordered_map>
+#include <utility>
+#include <cstdint>
+#include <limits>
+
+namespace dbn {
+
+	// Bounded LRU cache of a sensor model conditioned on evidence. The
+	// evidence restricted to the sensor model scope is packed into a single
+	// integer in mixed radix (value + 1 per variable, 0 if unobserved).
+	// V is the type returned by T::conditioning.
+	template<class T, class V = T>
+	class SensorCache {
+	public:
+		SensorCache(const T &sensor_model, unsigned capacity) :
+			_sensor_model(sensor_model), _capacity(capacity), _hits(0), _misses(0)
+		{
+			uint64_t space = 1;
+			for (auto pv : sensor_model.domain().scope()) {
+				uint64_t radix = pv->size() + 1;
+				if (space > std::numeric_limits<uint64_t>::max() / radix) {
+					_capacity = 0;
+					break;
+				}
+				space *= radix;
+				_scope.push_back(pv);
+			}
+		}
+
+		const V &operator()(const std::unordered_map<unsigned,unsigned> &evidence) {
+			if (_capacity == 0) {
+				_misses++;
+				_entries.clear();
+				_entries.emplace_front(0, _sensor_model.conditioning(evidence));
+				return _entries.front().second;
+			}
+
+			uint64_t key = pack(evidence);
+			auto it_index = _index.find(key);
+			if (it_index != _index.end()) {
+				_hits++;
+				_entries.splice(_entries.begin(), _entries, it_index->second);
+				return it_index->second->second;
+			}
+
+			_misses++;
+			return insert(key, evidence);
+		}
+
+		// same, keyed directly from a packed evidence row; the evidence map
+		// is only built to condition on a miss
+		const V &operator()(const EvidenceRow &row) {
+			if (_capacity == 0) return (*this)(row.observed());
+
+			uint64_t key = pack(row);
+			auto it_index = _index.find(key);
+			if (it_index != _index.end()) {
+				_hits++;
+				_entries.splice(_entries.begin(), _entries, it_index->second);
+				return it_index->second->second;
+			}
+
+			_misses++;
+			return insert(key, row.observed());
+		}
+
+		// condition on every complete observation of the given sensor
+		// variables, provided that they all fit in the cache
+		void prewarm(const std::set<unsigned> &sensor) {
+			std::vector<const Variable*> observed;
+			double space = 1.0;
+			for (auto pv : _scope) {
+				if (sensor.count(pv->id())) {
+					observed.push_back(pv);
+					space *= pv->size();
+				}
+			}
+			if (observed.empty() || space > _capacity) return;
+
+			unsigned width = observed.size();
+			std::vector<unsigned> inst(width, 0);
+			std::unordered_map<unsigned,unsigned> evidence;
+			while (true) {
+				for (unsigned i = 0; i < width; ++i) {
+					evidence[observed[i]->id()] = inst[i];
+				}
+				uint64_t key = pack(evidence);
+				if (!_index.count(key)) {
+					insert(key, evidence);
+				}
+
+				int j;
+				for (j = width-1; j >= 0 && inst[j] == observed[j]->size()-1; --j) {
+					inst[j] = 0;
+				}
+				if (j < 0) break;
+				inst[j]++;
+			}
+		}
+
+		unsigned size()   const { return _entries.size(); }
+		unsigned hits()   const { return _hits;   }
+		unsigned misses() const { return _misses; }
+
+	private:
+		uint64_t pack(const std::unordered_map<unsigned,unsigned> &evidence) const {
+			uint64_t key = 0;
+			for (auto pv : _scope) {
+				auto it_evidence = evidence.find(pv->id());
+				key = key * (pv->size() + 1) + (it_evidence != evidence.end() ? it_evidence->second + 1 : 0);
+			}
+			return key;
+		}
+
+		uint64_t pack(const EvidenceRow &row) const {
+			uint64_t key = 0;
+			for (auto pv : _scope) {
+				int column = row.column(pv->id());
+				Evidence::value_type value = (column >= 0 ? row.value(column) : Evidence::MISSING);
+				key = key * (pv->size() + 1) + (value != Evidence::MISSING ? value + 1 : 0);
+			}
+			return key;
+		}
+
+		const V &insert(uint64_t key, const std::unordered_map<unsigned,unsigned> &evidence) {
+			if (_entries.size() >= _capacity) {
+				_index.erase(_entries.back().first);
+				_entries.pop_back();
+			}
+			_entries.emplace_front(key, _sensor_model.conditioning(evidence));
+			_index[key] = _entries.begin();
+			return _entries.front().second;
+		}
+
+		const T &_sensor_model;
+		std::vector<const Variable*> _scope;
+		unsigned _capacity;
+
+		std::list<std::pair<uint64_t,V>> _entries;
+		std::unordered_map<uint64_t,typename std::list<std::pair<uint64_t,V>>::iterator> _index;
+
+		unsigned _hits;
+		unsigned _misses;
+	};
+
+}
+
+#endif
@@ -0,0 +1,210 @@
+// Copyright (c) 2015 Thiago Pereira Bueno
+// All Rights Reserved.
+//
+// This file is part of DBN library.
+//
+// DBN is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// DBN is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DBN.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "addcontext.h"
+#include "mtr.h"
+#include "memoryaccountant.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+using namespace std;
+
+namespace dbn {
+
+	// failed CUDD operations reach the error handler of the C++ wrapper;
+	// running out of the memory cap of a budgeted run becomes a
+	// MemoryLimitExceeded, any other error keeps the default behaviour
+	static void cudd_error(string message) {
+		if (MemoryAccountant::limit() && message.find("emory") != string::npos) {
+			throw MemoryLimitExceeded("decision diagram manager (" + message + ")", 0.0);
+		}
+		throw logic_error(message);
+	}
+
+	ADDContext::ADDContext() : _mgr(0,0), _next_index(0), _bytes(0) {
+		_mgr.setHandler(cudd_error);
+		account();
+	}
+
+	ADDContext::~ADDContext() {
+		MemoryAccountant::release(_bytes);
+	}
+
+	// nodes and tables are allocated inside CUDD, so the manager memory is
+	// sampled rather than counted per allocation; under a budget, CUDD is
+	// capped to what the rest of the process leaves, so that a single step
+	// cannot grow past the limit
+	void ADDContext::account() {
+		size_t bytes = _mgr.ReadMemoryInUse();
+		MemoryAccountant::release(_bytes);
+		MemoryAccountant::allocate(bytes);
+		_bytes = bytes;
+
+		size_t limit = MemoryAccountant::limit();
+		if (limit) {
+			size_t others = MemoryAccountant::current() - _bytes;
+			Cudd_SetMaxMemory(_mgr.getManager(), limit > others ? limit - others : 0);
+		}
+	}
+
+	void ADDContext::set_reordering(int *permutation) {
+		if (!permutation) {
+			// _mgr.AutodynEnable();
+			_mgr.AutodynDisable();
+		}
+		else {
+			_mgr.ShuffleHeap(permutation);
+		}
+	}
+
+	const vector<int> &ADDContext::bits(const Variable *variable) {
+		auto it = _encoding.find(variable->id());
+		if (it != _encoding.end()) return it->second;
+
+		unsigned nbits = 1;
+		while ((1u << nbits) < variable->size()) nbits++;
+
+		vector<int> &indices = _encoding[variable->id()];
+		for (unsigned b = 0; b < nbits; ++b) {
+			_mgr.addVar(_next_index);
+			indices.push_back(_next_index++);
+		}
+		return indices;
+	}
+
+	void ADDContext::group(const vector<const Variable*> &variables) {
+		vector<const Variable*> pending;
+		unsigned nbits = 0;
+		for (auto pv : variables) {
+			if (_encoding.count(pv->id())) continue;
+			pending.push_back(pv);
+			unsigned n = 1;
+			while ((1u << n) < pv->size()) n++;
+			nbits = max(nbits, n);
+		}
+		if (pending.empty()) return;
+
+		int low = _next_index;
+		for (unsigned b = 0; b < nbits; ++b) {
+			for (auto pv : pending) {
+				unsigned n = 1;
+				while ((1u << n) < pv->size()) n++;
+				if (b >= n) continue;
+				_mgr.addVar(_next_index);
+				_encoding[pv->id()].push_back(_next_index++);
+			}
+		}
+		if (_next_index - low > 1) {
+			_mgr.MakeTreeNode(low, _next_index - low, MTR_DEFAULT);
+		}
+	}
+
+	void ADDContext::reorder() {
+		_mgr.ReduceHeap(CUDD_REORDER_GROUP_SIFT, 0);
+	}
+
+	ADD ADDContext::code(const Variable *variable, unsigned value) {
+		const vector<int> &indices = bits(variable);
+		unsigned nbits = indices.size();
+		ADD cube = _mgr.constant(1.0);
+		for (unsigned b = 0; b < nbits; ++b) {
+			ADD v = _mgr.addVar(indices[b]);
+			cube *= ((value >> (nbits-1-b)) & 1 ? v : ~v);
+		}
+		return cube;
+	}
+
+	ADD ADDContext::mask(const Variable *variable) {
+		const vector<int> &indices = bits(variable);
+		if ((1u << indices.size()) == variable->size()) return _mgr.addOne();
+		ADD valid = _mgr.addZero();
+		for (unsigned value = 0; value < variable->size(); ++value) {
+			valid += code(variable, value);
+		}
+		return valid;
+	}
+
+	ADDStatistics ADDContext::statistics() const {
+		ADDStatistics stats;
+		stats.live_nodes = _mgr.ReadNodeCount();
+		stats.peak_live_nodes = _mgr.ReadPeakLiveNodeCount();
+		stats.cache_hits = _mgr.ReadCacheHits();
+		stats.cache_lookups = _mgr.ReadCacheLookUps();
+		stats.garbage_collections = _mgr.ReadGarbageCollections();
+		stats.garbage_collection_time = _mgr.ReadGarbageCollectionTime();
+		stats.reorderings = _mgr.ReadReorderings();
+		stats.reordering_time = _mgr.ReadReorderingTime();
+		stats.memory = _mgr.ReadMemoryInUse();
+		return stats;
+	}
+
+	void ADDContext::record_step() {
+		_steps.push_back(statistics());
+		account();
+		MemoryAccountant::check(0.0, "decision diagram manager");
+	}
+
+	void ADDStatistics::print_columns(ostream &os) const {
+		os << peak_live_nodes << ";";
+		os << cache_hit_rate() << ";";
+		os << garbage_collections << ";" << garbage_collection_time << ";";
+		os << reorderings << ";" << reordering_time << ";";
+		os << memory << ";";
+	}
+
+	static void write_json(ostream &os, const ADDStatistics &stats) {
+		os << "{\"live_nodes\": " << stats.live_nodes;
+		os << ", \"peak_live_nodes\": " << stats.peak_live_nodes;
+		os << ", \"cache_hits\": " << stats.cache_hits;
+		os << ", \"cache_lookups\": " << stats.cache_lookups;
+		os << ", \"cache_hit_rate\": " << stats.cache_hit_rate();
+		os << ", \"gc_count\": " << stats.garbage_collections;
+		os << ", \"gc_time_ms\": " << stats.garbage_collection_time;
+		os << ", \"reorder_count\": " << stats.reorderings;
+		os << ", \"reorder_time_ms\": " << stats.reordering_time;
+		os << ", \"memory_bytes\": " << stats.memory << "}";
+	}
+
+	// per-step entries hold the counters accrued during that step, except
+	// live and peak nodes and memory which are the values at its end
+	void ADDContext::write_statistics(ostream &os) const {
+		os << "{" << endl;
+		os << "  \"total\": ";
+		write_json(os, statistics());
+		os << "," << endl;
+		os << "  \"steps\": [";
+		ADDStatistics previous;
+		for (unsigned t = 0; t < _steps.size(); ++t) {
+			ADDStatistics step = _steps[t];
+			step.cache_hits -= previous.cache_hits;
+			step.cache_lookups -= previous.cache_lookups;
+			step.garbage_collections -= previous.garbage_collections;
+			step.garbage_collection_time -= previous.garbage_collection_time;
+			step.reorderings -= previous.reorderings;
+			step.reordering_time -= previous.reordering_time;
+			os << (t ? "," : "") << endl << "    ";
+			write_json(os, step);
+			previous = _steps[t];
+		}
+		os << endl << "  ]" << endl;
+		os << "}" << endl;
+	}
+
+}
@@ -18,69 +18,104 @@
 
 #include "addfactor.h"
 #include "domain.h"
+#include "memoryaccountant.h"
+#include "profiler.h"
 #include "cudd.h"
 #include "cuddObj.hh"
 
 #include <cstdio>
+#include <algorithm>
 #include <iostream>
 
 using namespace std;
 
 namespace dbn {
 
-	Cudd ADDFactor::mgr(0,0);
-
-	void ADDFactor::set_mgr_reordering(int *permutation) {
-		if (!permutation) {
-			// mgr.AutodynEnable();
-			mgr.AutodynDisable();
-		}
-		else {
-			mgr.ShuffleHeap(permutation);
-		}
-	}
-
-	ADDFactor::ADDFactor(const string &output, double value) :
-		_dd(mgr.constant(value)),
+	ADDFactor::ADDFactor(ADDContext &context, const string &output, double value) :
+		_context(&context),
+		_dd(context.mgr().constant(value)),
 		_output(output),
 		_domain(unique_ptr<Domain>(new Domain)) { }
 			
-	ADDFactor::ADDFactor(const string &output, const Factor &factor) :
+	ADDFactor::ADDFactor(ADDContext &context, const string &output, const Factor &factor) :
+		_context(&context),
 		_output(output),
 		_domain(new Domain(factor.domain())) {
 
-		_dd = mgr.addZero();
-
-		unsigned width = factor.width();
-		vector<unsigned> inst(width, 0);
+		vector<unsigned> codes(_domain->width(), 0);
+		_dd = build(context, factor, table_bits(context, *_domain), 0, codes);
+	}
 
-		for (unsigned l = 0; l < factor.size(); ++l) {
-			unsigned pos = _domain->position_instantiation(inst);
-			double value = factor[pos];
-			ADD line = mgr.constant(value);
+	// decision bits of all variables in domain sorted by level
+	vector<ADDFactor::TableBit> ADDFactor::table_bits(ADDContext &context, const Domain &domain) {
+		unsigned width = domain.width();
+		vector<TableBit> order;
+		for (unsigned i = 0; i < width; ++i) {
+			const vector<int> &indices = context.bits(domain[i]);
+			unsigned nbits = indices.size();
+			for (unsigned b = 0; b < nbits; ++b) {
+				order.push_back(TableBit { indices[b], i, 1u << (nbits-1-b) });
+			}
+		}
+		sort(order.begin(), order.end(),
+			[&context](const TableBit &b1, const TableBit &b2) { return context.mgr().ReadPerm(b1.index) < context.mgr().ReadPerm(b2.index); });
+		return order;
+	}
 
+	// bottom-up construction in one pass over the table: each node is
+	// created on top of its already reduced cofactors, so the unique table
+	// does all the work and no intermediate diagrams are combined
+	ADD ADDFactor::build(ADDContext &context, const Factor &factor, const vector<TableBit> &order, unsigned k, vector<unsigned> &codes) {
+		if (k == order.size()) {
+			const Domain &domain = factor.domain();
+			unsigned pos = 0;
+			unsigned width = domain.width();
 			for (unsigned i = 0; i < width; ++i) {
-				ADD v = mgr.addVar((*_domain)[i]->id());
-				line *= (inst[i] ? v : ~v);
+				if (codes[i] >= domain[i]->size()) return context.mgr().addZero();
+				pos += codes[i] * domain.offset(i);
 			}
-
-			_dd += line;
-			_domain->next_instantiation(inst);
+			return context.mgr().constant(factor[pos]);
 		}
+
+		const TableBit &bit = order[k];
+		ADD low = build(context, factor, order, k+1, codes);
+		codes[bit.variable] |= bit.mask;
+		ADD high = build(context, factor, order, k+1, codes);
+		codes[bit.variable] &= ~bit.mask;
+
+		if (high == low) return low;
+		return context.mgr().addVar(bit.index).Ite(high, low);
 	}
 
-	ADDFactor::ADDFactor(const string &output, const ADD &dd, const Domain &domain) :
+	ADDFactor::ADDFactor(ADDContext &context, const string &output, const ADD &dd, const Domain &domain) :
+		_context(&context),
 		_dd(dd),
 		_output(output),
 		_domain(unique_ptr<Domain>(new Domain(domain))) { }
 
+	ADDFactor::ADDFactor(ADDContext &context, const string &output, const Node *nodes, size_t count, const Domain &domain) :
+		_context(&context),
+		_output(output),
+		_domain(unique_ptr<Domain>(new Domain(domain))) {
+
+		vector<ADD> built(count);
+		for (size_t i = 0; i < count; ++i) {
+			const Node &node = nodes[i];
+			if (node.index < 0) built[i] = context.mgr().constant(node.value);
+			else built[i] = context.mgr().addVar(node.index).Ite(built[node.high], built[node.low]);
+		}
+		_dd = (count ? built[count-1] : context.mgr().addZero());
+	}
+
 	ADDFactor::ADDFactor(const ADDFactor &f) {
+		_context = f._context;
 		_dd = f._dd;
 		_output = f._output;
 		_domain = unique_ptr<Domain>(new Domain(*f._domain));
 	}
 
 	ADDFactor::ADDFactor(ADDFactor &&f) {
+		_context = f._context;
 		_dd = f._dd;
 		_output = f._output;
 		_domain = move(f._domain);
@@ -89,6 +124,7 @@ namespace dbn {
 
 	ADDFactor &ADDFactor::operator=(ADDFactor &&f) {
 		if (this != &f) {
+			_context = f._context;
 			_dd = f._dd;
 			_output = f._output;
 			_domain = move(f._domain);
@@ -114,15 +150,89 @@ namespace dbn {
 	}
 
 	double ADDFactor::partition() const {
-		int width = _domain->width();
-		int size = _domain->size();
-		vector<unsigned> inst(width, 0);
-		double partition = 0;
-		for (int i = 0; i < size; ++i) {
-			partition += (*this)[inst];
-			_domain->next_instantiation(inst);
+		// abstract all variables of the domain, restricted to valid codes
+		ADD cube = _context->mgr().addOne();
+		ADD valid = _dd;
+		for (auto pv : _domain->scope()) {
+			for (auto index : _context->bits(pv)) {
+				cube *= _context->mgr().addVar(index);
+			}
+			valid *= _context->mask(pv);
 		}
-		return partition;
+		return Cudd_V(valid.ExistAbstract(cube).getNode());
+	}
+
+	// dense table in domain order, one traversal of the diagram
+	Factor ADDFactor::to_factor() const {
+		Factor factor(new Domain(*_domain), 0.0);
+		vector<unsigned> codes(_domain->width(), 0);
+		export_table(_dd.getNode(), table_bits(*_context, *_domain), 0, codes, factor);
+
+		double partition = 0.0;
+		unsigned size = factor.size();
+		for (unsigned i = 0; i < size; ++i) {
+			partition += factor[i];
+		}
+		factor.partition(partition);
+		return factor;
+	}
+
+	void ADDFactor::export_table(DdNode *node, const vector<TableBit> &order, unsigned k, vector<unsigned> &codes, Factor &factor) {
+		if (k == order.size()) {
+			const Domain &domain = factor.domain();
+			unsigned pos = 0;
+			unsigned width = domain.width();
+			for (unsigned i = 0; i < width; ++i) {
+				if (codes[i] >= domain[i]->size()) return;
+				pos += codes[i] * domain.offset(i);
+			}
+			factor[pos] = Cudd_V(node);
+			return;
+		}
+
+		// node does not depend on bit k unless it is labelled with it
+		const TableBit &bit = order[k];
+		DdNode *low = node, *high = node;
+		if (!Cudd_IsConstant(node) && (int) Cudd_NodeReadIndex(node) == bit.index) {
+			low = Cudd_E(node);
+			high = Cudd_T(node);
+		}
+		export_table(low, order, k+1, codes, factor);
+		codes[bit.variable] |= bit.mask;
+		export_table(high, order, k+1, codes, factor);
+		codes[bit.variable] &= ~bit.mask;
+	}
+
+	vector<ADDFactor::Node> ADDFactor::nodes() const {
+		unordered_map<DdNode*,uint32_t> numbers;
+		vector<Node> nodes;
+		export_nodes(_dd.getNode(), numbers, nodes);
+		return nodes;
+	}
+
+	uint32_t ADDFactor::export_nodes(DdNode *node, unordered_map<DdNode*,uint32_t> &numbers, vector<Node> &nodes) {
+		auto it_numbers = numbers.find(node);
+		if (it_numbers != numbers.end()) return it_numbers->second;
+
+		Node n { 0.0, -1, 0, 0, 0 };
+		if (Cudd_IsConstant(node)) {
+			n.value = Cudd_V(node);
+		}
+		else {
+			n.index = Cudd_NodeReadIndex(node);
+			n.high = export_nodes(Cudd_T(node), numbers, nodes);
+			n.low = export_nodes(Cudd_E(node), numbers, nodes);
+		}
+		nodes.push_back(n);
+		return numbers[node] = nodes.size() - 1;
+	}
+
+	vector<double> ADDFactor::values(const Domain &domain) const {
+		return to_factor().values(domain);
+	}
+
+	unsigned ADDFactor::node_count() const {
+		return _dd.nodeCount();
 	}
 
 	double ADDFactor::compactation() const {
@@ -137,16 +247,20 @@ namespace dbn {
 		new_domain.modify_scope(renaming);
 
 		vector<ADD> x, y;
-		for (auto it_renaming : renaming) {
-			unsigned from = it_renaming.first;
-			unsigned to = it_renaming.second->id();
-			x.push_back(mgr.addVar(from));
-			y.push_back(mgr.addVar(to));
+		for (auto pv : _domain->scope()) {
+			auto it_renaming = renaming.find(pv->id());
+			if (it_renaming == renaming.end()) continue;
+			const vector<int> &from = _context->bits(pv);
+			const vector<int> &to = _context->bits(it_renaming->second);
+			for (unsigned b = 0; b < from.size(); ++b) {
+				x.push_back(_context->mgr().addVar(from[b]));
+				y.push_back(_context->mgr().addVar(to[b]));
+			}
 		}
 		ADD swapped = _dd.SwapVariables(x, y);
 
 		string output = "renamed(" + _output + ")";
-		return ADDFactor(output, swapped, new_domain);
+		return ADDFactor(*_context, output, swapped, new_domain);
 	}
 
 	bool ADDFactor::in_scope(const Variable *variable) const {
@@ -154,24 +268,79 @@ namespace dbn {
 	}
 
 	ADDFactor ADDFactor::sum_out(const Variable *variable) const {
-		unsigned index = variable->id();
-		string output = "sum_out(" + _output + "," + to_string(index) + ")";
-
-		if (!in_scope(variable)) return ADDFactor(output, _dd, *_domain);
+		return sum_out(vector<const Variable*>(1, variable));
+	}
 
-		ADD positive = mgr.addVar(index);
-		ADD negated  = ~positive;
-		ADD summed_out = _dd.Restrict(positive) + _dd.Restrict(negated);
+	ADDFactor ADDFactor::sum_out(const vector<const Variable*> &variables) const {
+		string output = "sum_out(" + _output + ",{";
+
+		// cube of all bits to abstract, invalid codes masked out
+		ADD cube = _context->mgr().addOne();
+		ADD valid = _dd;
+		for (auto pv : variables) {
+			if (!in_scope(pv)) continue;
+			output += " " + to_string(pv->id());
+			for (auto index : _context->bits(pv)) {
+				cube *= _context->mgr().addVar(index);
+			}
+			valid *= _context->mask(pv);
+		}
+		output += " })";
 
 		vector<const Variable*> scope;
 		for (auto pv : _domain->scope()) {
-			if (pv->id() != index) {
+			if (find(variables.begin(), variables.end(), pv) == variables.end()) {
 				scope.push_back(pv);
 			}
 		}
 		Domain domain(scope);
 
-		return ADDFactor(output, summed_out, domain);
+		ADD marginal = valid.ExistAbstract(cube);
+		if (Profiler::enabled()) Profiler::sum_out(_dd.nodeCount(), marginal.nodeCount());
+		return ADDFactor(*_context, output, marginal, domain);
+	}
+
+	ADDFactor ADDFactor::sum_product(ADDContext &context, const vector<shared_ptr<ADDFactor>> &factors, const vector<const Variable*> &variables) {
+		if (factors.empty()) return ADDFactor(context);
+
+		// product of all but the last factor
+		ADDFactor prod(*factors[0]);
+		unsigned nfactors = factors.size();
+		for (unsigned i = 1; i+1 < nfactors; ++i) {
+			prod *= *factors[i];
+		}
+		if (nfactors == 1) return prod.sum_out(variables);
+		const ADDFactor &last = *factors[nfactors-1];
+
+		// summation bits of variables in the joint scope, invalid codes masked out
+		string output = "sum_product(" + prod._output + "*" + last._output + ",{";
+		vector<ADD> z;
+		ADD valid = prod._dd;
+		for (auto pv : variables) {
+			if (!prod.in_scope(pv) && !last.in_scope(pv)) continue;
+			output += " " + to_string(pv->id());
+			for (auto index : context.bits(pv)) {
+				z.push_back(context.mgr().addVar(index));
+			}
+			valid *= context.mask(pv);
+		}
+		output += " })";
+
+		vector<const Variable*> scope;
+		for (auto pv : Domain(prod.domain(), last.domain()).scope()) {
+			if (find(variables.begin(), variables.end(), pv) == variables.end()) {
+				scope.push_back(pv);
+			}
+		}
+		Domain domain(scope);
+
+		// multiply and abstract in one pass, never building the full product
+		ADD marginal = valid.MatrixMultiply(last._dd, z);
+		if (Profiler::enabled()) {
+			Profiler::product(prod._dd.nodeCount() + last._dd.nodeCount(), marginal.nodeCount());
+			Profiler::sum_out(0, marginal.nodeCount());
+		}
+		return ADDFactor(context, output, marginal, domain);
 	}
 
 	ADDFactor ADDFactor::product(const ADDFactor &f) const {
@@ -186,57 +355,129 @@ namespace dbn {
 		Domain domain(scope);
 
 		ADD prod = _dd * f._dd;
+		if (Profiler::enabled()) Profiler::product(_dd.nodeCount() + f._dd.nodeCount(), prod.nodeCount());
 
-		return ADDFactor(output, prod, domain);
+		return ADDFactor(*_context, output, prod, domain);
 	}
 
 	ADDFactor ADDFactor::normalize() const {
-		DdManager *ddmgr = mgr.getManager();
+		DdManager *ddmgr = _context->mgr().getManager();
 		DdNode *partitionNode = Cudd_addConst(ddmgr, partition());
 		Cudd_Ref(partitionNode);
 
+		// the ADD wrapper takes its own reference to the result
 		DdNode *ddNode = Cudd_addApply(ddmgr, Cudd_addDivide, _dd.getNode(), partitionNode);
-		Cudd_Ref(ddNode);
+		Cudd_RecursiveDeref(ddmgr, partitionNode);
+		if (!ddNode) throw MemoryLimitExceeded("decision diagram manager (normalize)", 0.0);
+		ADD dd(_context->mgr(), ddNode);
 
+		if (Profiler::enabled()) Profiler::touch(_dd.nodeCount());
 		string output = "norm(" + _output + ")";
-		return ADDFactor(output, ADD(mgr, ddNode), *_domain);
+		return ADDFactor(*_context, output, dd, *_domain);
+	}
+
+	ADDFactor ADDFactor::approximate(double epsilon, double &error) const {
+		vector<double> values;
+		unordered_map<DdNode*,bool> visited;
+		leaves(_dd.getNode(), visited, values);
+		sort(values.begin(), values.end());
+
+		// exact zeros (impossible states and the padding codes of
+		// ADDContext::mask) are never merged with positive leaves
+		error = 0.0;
+		unordered_map<double,double> merged;
+		unsigned n = values.size();
+		unsigned first = 0;
+		while (first < n && values[first] <= 0.0) {
+			merged[values[first]] = values[first];
+			++first;
+		}
+
+		// greedily cover the sorted leaves with ranges of width epsilon
+		for (unsigned i = first, j = first; i < n; i = j) {
+			while (j < n && values[j] - values[i] <= epsilon) ++j;
+			double midpoint = (values[i] + values[j-1]) / 2;
+			for (unsigned k = i; k < j; ++k) {
+				merged[values[k]] = midpoint;
+			}
+			error = max(error, (values[j-1] - values[i]) / 2);
+		}
+		if (merged.size() == 0 || error == 0.0) return ADDFactor(*this);
+
+		unordered_map<DdNode*,ADD> cache;
+		ADD dd = replace(*_context, _dd.getNode(), merged, cache);
+
+		string output = "approx(" + _output + ")";
+		return ADDFactor(*_context, output, dd, *_domain);
+	}
+
+	void ADDFactor::leaves(DdNode *node, unordered_map<DdNode*,bool> &visited, vector<double> &values) {
+		if (visited.count(node)) return;
+		visited[node] = true;
+		if (Cudd_IsConstant(node)) {
+			values.push_back(Cudd_V(node));
+			return;
+		}
+		leaves(Cudd_T(node), visited, values);
+		leaves(Cudd_E(node), visited, values);
+	}
+
+	ADD ADDFactor::replace(ADDContext &context, DdNode *node, const unordered_map<double,double> &merged, unordered_map<DdNode*,ADD> &cache) {
+		auto it_cache = cache.find(node);
+		if (it_cache != cache.end()) return it_cache->second;
+
+		ADD result;
+		if (Cudd_IsConstant(node)) {
+			result = context.mgr().constant(merged.at(Cudd_V(node)));
+		}
+		else {
+			ADD high = replace(context, Cudd_T(node), merged, cache);
+			ADD low = replace(context, Cudd_E(node), merged, cache);
+			result = context.mgr().addVar(Cudd_NodeReadIndex(node)).Ite(high, low);
+		}
+		cache[node] = result;
+		return result;
 	}
 
 	ADDFactor ADDFactor::conditioning(const unordered_map<unsigned,unsigned> &evidence) const {
 		string output = "cond(" + _output + ",{";
-		ADD evidenceVariables = mgr.constant(1.0);
-		for (auto it : evidence) {
-			unsigned id = it.first;
-			unsigned value = it.second;
-			output += " " + to_string(id) + ":" + to_string(value);
-			evidenceVariables *= (value ? mgr.addVar(id) : ~mgr.addVar(id));
-		}
-		output += " })";
+		ADD evidenceVariables = _context->mgr().constant(1.0);
 		vector<const Variable*> scope;
 		for (auto pv : _domain->scope()) {
-			if (evidence.find(pv->id()) == evidence.end()) {
+			auto it = evidence.find(pv->id());
+			if (it == evidence.end()) {
 				scope.push_back(pv);
+				continue;
 			}
+			unsigned id = it->first;
+			unsigned value = it->second;
+			output += " " + to_string(id) + ":" + to_string(value);
+			evidenceVariables *= _context->code(pv, value);
 		}
+		output += " })";
 		Domain domain(scope);
 		ADD conditioned = _dd.Restrict(evidenceVariables);
-		return ADDFactor(output, conditioned, domain);
+		if (Profiler::enabled()) Profiler::touch(_dd.nodeCount());
+		return ADDFactor(*_context, output, conditioned, domain);
 	}
 
 	double ADDFactor::operator[](vector<unsigned> instantiation) const {
 		DdNode *node = _dd.getNode();
 		if (Cudd_IsConstant(node)) return Cudd_V(node);
 
-		DdManager *mgr = ADDFactor::mgr.getManager();
+		DdManager *mgr = _context->mgr().getManager();
 		int N = Cudd_ReadSize(mgr);
 
 		int *inputs = new int[N];
-		for (int id = 0; id < N; ++id) {
-			if (_domain->in_scope(id)) {
-				inputs[id] = instantiation[_domain->index(id)];
-			}
-			else {
-				inputs[id] = 2;
+		for (int index = 0; index < N; ++index) {
+			inputs[index] = 0;
+		}
+		unsigned width = _domain->width();
+		for (unsigned i = 0; i < width; ++i) {
+			const vector<int> &indices = _context->bits((*_domain)[i]);
+			unsigned nbits = indices.size();
+			for (unsigned b = 0; b < nbits; ++b) {
+				inputs[indices[b]] = (instantiation[i] >> (nbits-1-b)) & 1;
 			}
 		}
 
@@ -255,7 +496,7 @@ namespace dbn {
 		outputs[0] = _dd.getNode();
 		const char *outputNames[1];
 		outputNames[0] = _output.c_str();
-		result = Cudd_DumpDot(mgr.getManager(), 1, outputs, NULL, outputNames, f);
+		result = Cudd_DumpDot(_context->mgr().getManager(), 1, outputs, NULL, outputNames, f);
 		fclose(f);
 		return !result;
 	}
@@ -293,7 +534,7 @@ namespace dbn {
 
 		// f._dd.print(width,3);
 
-		// DdManager *mgr = ADDFactor::mgr.getManager();
+		// DdManager *mgr = ADDFactor::_context->mgr().getManager();
 
 		// int *support;
 		// int support_size = Cudd_SupportIndices(mgr, f._dd.getNode(), &support);
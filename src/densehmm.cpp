@@ -0,0 +1,140 @@
+// Copyright (c) 2015 Thiago Pereira Bueno
+// All Rights Reserved.
+//
+// This file is part of DBN library.
+//
+// DBN is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// DBN is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DBN.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "densehmm.h"
+#include "memoryaccountant.h"
+
+#include <algorithm>
+
+using namespace std;
+
+namespace dbn {
+
+	// columns per block, so that a block of the output row stays in L1
+	static const unsigned BLOCK = 512;
+
+	DenseHMM::DenseHMM(
+		const vector<const Variable*> &variables,
+		const vector<shared_ptr<Factor>> &factors,
+		const unordered_map<unsigned,const Variable*> &transition,
+		const Factor &sensor_model) : _sensor_model(sensor_model)
+	{
+		vector<const Variable*> curr, next;
+		for (auto it_transition : transition) {
+			curr.push_back(it_transition.second);
+			next.push_back(variables[it_transition.first]);
+		}
+		_interface = Domain(curr);
+
+		// joint (slice t, slice t+1) domain linearized as row * |S| + column
+		vector<const Variable*> scope(curr);
+		scope.insert(scope.end(), next.begin(), next.end());
+		Domain joint(scope);
+		MemoryAccountant::check(matrix_bytes(_interface.size()), "dense HMM transition matrix");
+		_matrix.assign(joint.size(), 1.0);
+		MemoryAccountant::allocate(_matrix.capacity() * sizeof(double));
+		for (auto it_transition : transition) {
+			const Factor &f = *factors[it_transition.first];
+			vector<unsigned> positions = index_map(joint, f.domain());
+			unsigned joint_size = joint.size();
+			for (unsigned k = 0; k < joint_size; ++k) {
+				_matrix[k] *= f[positions[k]];
+			}
+		}
+	}
+
+	DenseHMM::~DenseHMM()
+	{
+		MemoryAccountant::release(_matrix.capacity() * sizeof(double));
+	}
+
+	double
+	DenseHMM::states(const unordered_map<unsigned,const Variable*> &transition)
+	{
+		double states = 1.0;
+		for (auto it_transition : transition) {
+			states *= it_transition.second->size();
+		}
+		return states;
+	}
+
+	vector<double>
+	DenseHMM::conditioning(const unordered_map<unsigned,unsigned> &evidence) const
+	{
+		Factor likelihood = _sensor_model.conditioning(evidence);
+
+		// marginalize unobserved sensor variables
+		for (auto pv : likelihood.domain().scope()) {
+			if (!_interface.in_scope(pv)) {
+				likelihood = likelihood.sum_out(pv);
+			}
+		}
+		return vectorize(likelihood);
+	}
+
+	vector<double>
+	DenseHMM::vectorize(const Factor &factor) const
+	{
+		unsigned size = _interface.size();
+		vector<double> values(size);
+		vector<unsigned> positions = index_map(_interface, factor.domain());
+		for (unsigned i = 0; i < size; ++i) {
+			values[i] = factor[positions[i]];
+		}
+		return values;
+	}
+
+	Factor
+	DenseHMM::factor(const vector<double> &values) const
+	{
+		Factor f(new Domain(_interface), 0.0);
+		double partition = 0.0;
+		unsigned size = values.size();
+		for (unsigned i = 0; i < size; ++i) {
+			f[i] = values[i];
+			partition += values[i];
+		}
+		f.partition(partition);
+		return f;
+	}
+
+	void
+	DenseHMM::project(const double *beliefs, double *projections, unsigned batch) const
+	{
+		const unsigned n = _interface.size();
+		fill(projections, projections + batch * n, 0.0);
+
+		// y[b] += x[b][i] * M[i], one column block at a time
+		for (unsigned j0 = 0; j0 < n; j0 += BLOCK) {
+			unsigned j1 = min(n, j0 + BLOCK);
+			for (unsigned b = 0; b < batch; ++b) {
+				const double *x = beliefs + b * n;
+				double *y = projections + b * n;
+				for (unsigned i = 0; i < n; ++i) {
+					double xi = x[i];
+					if (xi == 0.0) continue;
+					const double *row = &_matrix[i * n];
+					for (unsigned j = j0; j < j1; ++j) {
+						y[j] += xi * row[j];
+					}
+				}
+			}
+		}
+	}
+
+}
@@ -29,7 +29,7 @@ namespace dbn {
     Domain::Domain(vector<const Variable*> scope) : _scope(scope), _width(scope.size()) {
         _size = 1;
         if (_width > 0) {
-            _offset.reserve(_width);
+            _offset.resize(_width);
             for (int i = _width-1; i >= 0; --i) {
                 _offset[i] = _size;
                 _size *= _scope[i]->size();
@@ -49,7 +49,7 @@ namespace dbn {
         }
         _width = _scope.size();
         _size = 1;
-        _offset.reserve(_width);
+        _offset.resize(_width);
         for (int i = _width-1; i >= 0; --i) {
             _offset[i] = _size;
             _size *= _scope[i]->size();
@@ -69,7 +69,7 @@ namespace dbn {
         _width = _scope.size();
         _size = 1;
         if (_width > 0) {
-            _offset.reserve(_width);
+            _offset.resize(_width);
             for (int i = _width-1; i >= 0; --i) {
                 _offset[i] = _size;
                 _size *= _scope[i]->size();
@@ -78,16 +78,26 @@ namespace dbn {
         }
     }
 
-    // Domain &Domain::operator=(const Domain &other) {
-    //     if (this != &other) {
-    //         _scope = other._scope;
-    //         _offset = other._offset;
-    //         _width = other._width;
-    //         _size = other._size;
-    //         _var_to_index = other._var_to_index;
-    //     }
-    //     return *this;
-    // }
+    Domain &Domain::operator=(const Domain &other) {
+        if (this != &other) {
+            _scope = other._scope;
+            _offset = other._offset;
+            _width = other._width;
+            _size = other._size;
+            _var_to_index = other._var_to_index;
+        }
+        return *this;
+    }
+
+    size_t Domain::memory() const {
+        size_t bytes = sizeof(Domain);
+        bytes += _scope.capacity() * sizeof(const Variable*);
+        bytes += _offset.capacity() * sizeof(unsigned);
+        // buckets plus one node (key, value, next pointer) per variable
+        bytes += _var_to_index.bucket_count() * sizeof(void*);
+        bytes += _var_to_index.size() * (2 * sizeof(unsigned) + sizeof(void*));
+        return bytes;
+    }
 
     const Variable *Domain::operator[](unsigned i) const {
         if (i < _width) return _scope[i];
@@ -210,4 +220,35 @@ namespace dbn {
         return o;
     }
 
+    vector<unsigned> index_map(const Domain &from, const Domain &to) {
+        unsigned width = from.width();
+        vector<unsigned> sizes(width);
+        vector<unsigned> strides(width, 0);
+        for (unsigned i = 0; i < width; ++i) {
+            const Variable *v = from[i];
+            sizes[i] = v->size();
+            if (to.in_scope(v)) {
+                strides[i] = to.offset(to[v]);
+            }
+        }
+
+        unsigned size = from.size();
+        vector<unsigned> positions(size);
+        vector<unsigned> inst(width, 0);
+        unsigned pos = 0;
+        for (unsigned i = 0; i < size; ++i) {
+            positions[i] = pos;
+            int j;
+            for (j = width-1; j >= 0 && inst[j] == sizes[j]-1; --j) {
+                pos -= inst[j] * strides[j];
+                inst[j] = 0;
+            }
+            if (j >= 0) {
+                inst[j]++;
+                pos += strides[j];
+            }
+        }
+        return positions;
+    }
+
 }
\ No newline at end of file
@@ -0,0 +1,522 @@
+// Copyright (c) 2015 Thiago Pereira Bueno
+// All Rights Reserved.
+//
+// This file is part of DBN library.
+//
+// DBN is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// DBN is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DBN.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "evddfactor.h"
+#include "profiler.h"
+
+#include <unordered_set>
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <cmath>
+
+using namespace std;
+
+namespace dbn {
+
+	typedef EVDDFactor::Node Node;
+	typedef EVDDFactor::Edge Edge;
+
+	static Node terminal { numeric_limits<unsigned>::max(), {}, 0 };
+	static const Edge zero { 0.0, &terminal };
+
+	struct NodeHash {
+		size_t operator()(const Node *n) const {
+			size_t h = n->level;
+			for (auto const &e : n->children) {
+				h = h * 31 + hash<double>()(e.weight);
+				h = h * 31 + hash<const Node*>()(e.node);
+			}
+			return h;
+		}
+	};
+
+	struct NodeEqual {
+		bool operator()(const Node *n1, const Node *n2) const {
+			if (n1->level != n2->level) return false;
+			unsigned arity = n1->children.size();
+			for (unsigned i = 0; i < arity; ++i) {
+				if (n1->children[i].weight != n2->children[i].weight) return false;
+				if (n1->children[i].node != n2->children[i].node) return false;
+			}
+			return true;
+		}
+	};
+
+	struct OperandsKey {
+		const Node *n1;
+		const Node *n2;
+		double ratio;
+		bool operator==(const OperandsKey &k) const { return n1 == k.n1 && n2 == k.n2 && ratio == k.ratio; }
+	};
+
+	struct OperandsHash {
+		size_t operator()(const OperandsKey &k) const {
+			size_t h = hash<const Node*>()(k.n1);
+			h = h * 31 + hash<const Node*>()(k.n2);
+			return h * 31 + hash<double>()(k.ratio);
+		}
+	};
+
+	static unordered_set<const Node*,NodeHash,NodeEqual> unique_table;
+	static unordered_map<OperandsKey,Edge,OperandsHash> multiply_cache;
+	static unordered_map<OperandsKey,Edge,OperandsHash> add_cache;
+
+	static void ref(const Node *n) {
+		if (n != &terminal) n->refs++;
+	}
+
+	static void unref(const Node *n) {
+		if (n != &terminal) n->refs--;
+	}
+
+	// keep 40 significant bits, so that weights that only differ by
+	// rounding in the last operations still hash to the same node
+	static double snap(double w) {
+		int exponent;
+		double mantissa = frexp(w, &exponent);
+		return ldexp(nearbyint(ldexp(mantissa, 40)), exponent - 40);
+	}
+
+	unordered_map<unsigned,unsigned> EVDDFactor::levels;
+	vector<const Variable*> EVDDFactor::variables;
+
+	void EVDDFactor::group(const vector<const Variable*> &variables) {
+		for (auto pv : variables) {
+			level(pv);
+		}
+	}
+
+	unsigned EVDDFactor::level(const Variable *variable) {
+		auto it_level = levels.find(variable->id());
+		if (it_level != levels.end()) return it_level->second;
+		unsigned l = variables.size();
+		levels[variable->id()] = l;
+		variables.push_back(variable);
+		return l;
+	}
+
+	unsigned EVDDFactor::live_nodes() {
+		return unique_table.size();
+	}
+
+	void EVDDFactor::collect() {
+		multiply_cache.clear();
+		add_cache.clear();
+
+		vector<const Node*> dead;
+		for (auto n : unique_table) {
+			if (n->refs == 0) dead.push_back(n);
+		}
+		while (!dead.empty()) {
+			const Node *n = dead.back();
+			dead.pop_back();
+			unique_table.erase(n);
+			for (auto const &e : n->children) {
+				if (e.node != &terminal && --e.node->refs == 0) {
+					dead.push_back(e.node);
+				}
+			}
+			delete n;
+		}
+	}
+
+	void EVDDFactor::reset() {
+		collect();
+		if (unique_table.empty()) {
+			levels.clear();
+			variables.clear();
+		}
+	}
+
+	EVDDFactor::EVDDFactor(double value) : _root { value, &terminal } { }
+
+	EVDDFactor::EVDDFactor(const Factor &factor) : _domain(factor.domain()) {
+		vector<unsigned> order(_domain.width());
+		for (unsigned i = 0; i < order.size(); ++i) {
+			order[i] = i;
+		}
+		sort(order.begin(), order.end(),
+			[this](unsigned i, unsigned j) { return level(_domain[i]) < level(_domain[j]); });
+		_root = build(factor, order, 0, 0);
+		ref(_root.node);
+	}
+
+	EVDDFactor::EVDDFactor(const Edge &root, const Domain &domain) : _root(root), _domain(domain) {
+		ref(_root.node);
+	}
+
+	EVDDFactor::EVDDFactor(const EVDDFactor &f) : _root(f._root), _domain(f._domain) {
+		ref(_root.node);
+	}
+
+	EVDDFactor::EVDDFactor(EVDDFactor &&f) : _root(f._root), _domain(f._domain) {
+		f._root = zero;
+	}
+
+	EVDDFactor::~EVDDFactor() {
+		unref(_root.node);
+	}
+
+	EVDDFactor &EVDDFactor::operator=(EVDDFactor &&f) {
+		if (this != &f) {
+			unref(_root.node);
+			_root = f._root;
+			_domain = f._domain;
+			f._root = zero;
+		}
+		return *this;
+	}
+
+	void EVDDFactor::operator*=(const EVDDFactor &f) {
+		*this = product(f);
+	}
+
+	bool EVDDFactor::in_scope(const Variable *variable) const {
+		return _domain.in_scope(variable);
+	}
+
+	Edge EVDDFactor::make(unsigned level, vector<Edge> &children) {
+		double weight = 0.0;
+		for (auto const &e : children) {
+			weight = max(weight, e.weight);
+		}
+		if (weight == 0.0) return zero;
+
+		for (auto &e : children) {
+			if (e.weight == 0.0) e.node = &terminal;
+			else e.weight = (e.weight == weight ? 1.0 : snap(e.weight / weight));
+		}
+
+		bool redundant = true;
+		for (auto const &e : children) {
+			redundant = redundant && e.weight == 1.0 && e.node == children[0].node;
+		}
+		if (redundant) return Edge { weight, children[0].node };
+
+		Node key { level, children, 0 };
+		auto it_node = unique_table.find(&key);
+		if (it_node != unique_table.end()) return Edge { weight, *it_node };
+
+		Node *n = new Node { level, children, 0 };
+		for (auto const &e : children) {
+			ref(e.node);
+		}
+		unique_table.insert(n);
+		return Edge { weight, n };
+	}
+
+	Edge EVDDFactor::build(const Factor &factor, const vector<unsigned> &order, unsigned k, unsigned position) {
+		if (k == order.size()) return Edge { factor[position], &terminal };
+
+		const Domain &domain = factor.domain();
+		const Variable *variable = domain[order[k]];
+		unsigned offset = domain.offset(order[k]);
+		vector<Edge> children(variable->size());
+		for (unsigned v = 0; v < variable->size(); ++v) {
+			children[v] = build(factor, order, k+1, position + v * offset);
+		}
+		return make(level(variable), children);
+	}
+
+	Edge EVDDFactor::multiply(const Edge &e1, const Edge &e2) {
+		if (e1.weight == 0.0 || e2.weight == 0.0) return zero;
+		double weight = e1.weight * e2.weight;
+		if (e1.node == &terminal) return Edge { weight, e2.node };
+		if (e2.node == &terminal) return Edge { weight, e1.node };
+
+		// product of the (normalized) nodes does not depend on edge weights
+		OperandsKey key { min(e1.node, e2.node, less<const Node*>()), max(e1.node, e2.node, less<const Node*>()), 1.0 };
+		auto it_cache = multiply_cache.find(key);
+		if (it_cache != multiply_cache.end()) {
+			return Edge { weight * it_cache->second.weight, it_cache->second.node };
+		}
+
+		const Node *n1 = key.n1, *n2 = key.n2;
+		unsigned top = min(n1->level, n2->level);
+		unsigned arity = variables[top]->size();
+		vector<Edge> children(arity);
+		for (unsigned i = 0; i < arity; ++i) {
+			Edge c1 = (n1->level == top ? n1->children[i] : Edge { 1.0, n1 });
+			Edge c2 = (n2->level == top ? n2->children[i] : Edge { 1.0, n2 });
+			children[i] = multiply(c1, c2);
+		}
+		Edge result = make(top, children);
+		multiply_cache[key] = result;
+		return Edge { weight * result.weight, result.node };
+	}
+
+	Edge EVDDFactor::add(const Edge &e1, const Edge &e2) {
+		if (e1.weight == 0.0) return e2;
+		if (e2.weight == 0.0) return e1;
+		if (e1.node == e2.node) return Edge { e1.weight + e2.weight, e1.node };
+
+		// w1 * n1 + w2 * n2 = w1 * (n1 + (w2/w1) * n2)
+		const Edge &a = (less<const Node*>()(e1.node, e2.node) ? e1 : e2);
+		const Edge &b = (less<const Node*>()(e1.node, e2.node) ? e2 : e1);
+		OperandsKey key { a.node, b.node, b.weight / a.weight };
+		auto it_cache = add_cache.find(key);
+		if (it_cache != add_cache.end()) {
+			return Edge { a.weight * it_cache->second.weight, it_cache->second.node };
+		}
+
+		const Node *n1 = key.n1, *n2 = key.n2;
+		unsigned top = min(n1->level, n2->level);
+		unsigned arity = variables[top]->size();
+		vector<Edge> children(arity);
+		for (unsigned i = 0; i < arity; ++i) {
+			Edge c1 = (n1->level == top ? n1->children[i] : Edge { 1.0, n1 });
+			Edge c2 = (n2->level == top ? n2->children[i] : Edge { 1.0, n2 });
+			c2.weight *= key.ratio;
+			children[i] = add(c1, c2);
+		}
+		Edge result = make(top, children);
+		add_cache[key] = result;
+		return Edge { a.weight * result.weight, result.node };
+	}
+
+	Edge EVDDFactor::sum_out(const Edge &e, unsigned level, unordered_map<const Node*,Edge> &cache) {
+		if (e.weight == 0.0) return zero;
+
+		// the function does not depend on the variable below this point
+		if (e.node->level > level) return Edge { e.weight * variables[level]->size(), e.node };
+
+		auto it_cache = cache.find(e.node);
+		if (it_cache != cache.end()) {
+			return Edge { e.weight * it_cache->second.weight, it_cache->second.node };
+		}
+
+		Edge result = zero;
+		if (e.node->level == level) {
+			for (auto const &c : e.node->children) {
+				result = add(result, c);
+			}
+		}
+		else {
+			vector<Edge> children;
+			for (auto const &c : e.node->children) {
+				children.push_back(sum_out(c, level, cache));
+			}
+			result = make(e.node->level, children);
+		}
+		cache[e.node] = result;
+		return Edge { e.weight * result.weight, result.node };
+	}
+
+	Edge EVDDFactor::restrict(const Edge &e, const unordered_map<unsigned,unsigned> &values, unordered_map<const Node*,Edge> &cache) {
+		if (e.node == &terminal) return e;
+
+		auto it_cache = cache.find(e.node);
+		if (it_cache != cache.end()) {
+			return Edge { e.weight * it_cache->second.weight, it_cache->second.node };
+		}
+
+		Edge result;
+		auto it_value = values.find(e.node->level);
+		if (it_value != values.end()) {
+			result = restrict(e.node->children[it_value->second], values, cache);
+		}
+		else {
+			vector<Edge> children;
+			for (auto const &c : e.node->children) {
+				children.push_back(restrict(c, values, cache));
+			}
+			result = make(e.node->level, children);
+		}
+		cache[e.node] = result;
+		return Edge { e.weight * result.weight, result.node };
+	}
+
+	// renaming that preserves the relative order of the levels in the support
+	Edge EVDDFactor::relabel(const Edge &e, const unordered_map<unsigned,unsigned> &levels, unordered_map<const Node*,Edge> &cache) {
+		if (e.node == &terminal) return e;
+
+		auto it_cache = cache.find(e.node);
+		if (it_cache != cache.end()) {
+			return Edge { e.weight * it_cache->second.weight, it_cache->second.node };
+		}
+
+		vector<Edge> children;
+		for (auto const &c : e.node->children) {
+			children.push_back(relabel(c, levels, cache));
+		}
+		auto it_level = levels.find(e.node->level);
+		Edge result = make(it_level != levels.end() ? it_level->second : e.node->level, children);
+		cache[e.node] = result;
+		return Edge { e.weight * result.weight, result.node };
+	}
+
+	// general renaming: sum over values v of [y = v] * rename(child_v)
+	Edge EVDDFactor::rename(const Edge &e, const unordered_map<unsigned,unsigned> &levels, unordered_map<const Node*,Edge> &cache) {
+		if (e.node == &terminal) return e;
+
+		auto it_cache = cache.find(e.node);
+		if (it_cache != cache.end()) {
+			return Edge { e.weight * it_cache->second.weight, it_cache->second.node };
+		}
+
+		auto it_level = levels.find(e.node->level);
+		unsigned l = (it_level != levels.end() ? it_level->second : e.node->level);
+		unsigned arity = e.node->children.size();
+		Edge result = zero;
+		for (unsigned v = 0; v < arity; ++v) {
+			vector<Edge> indicator(arity, zero);
+			indicator[v] = Edge { 1.0, &terminal };
+			Edge child = rename(e.node->children[v], levels, cache);
+			result = add(result, multiply(make(l, indicator), child));
+		}
+		cache[e.node] = result;
+		return Edge { e.weight * result.weight, result.node };
+	}
+
+	double EVDDFactor::partition() const {
+		Edge e = _root;
+		for (auto pv : _domain.scope()) {
+			unordered_map<const Node*,Edge> cache;
+			e = sum_out(e, level(pv), cache);
+		}
+		return e.weight;
+	}
+
+	unsigned EVDDFactor::node_count() const {
+		unordered_set<const Node*> visited { &terminal };
+		vector<const Node*> stack { _root.node };
+		while (!stack.empty()) {
+			const Node *n = stack.back();
+			stack.pop_back();
+			for (auto const &c : n->children) {
+				if (visited.insert(c.node).second) stack.push_back(c.node);
+			}
+			visited.insert(n);
+		}
+		return visited.size();
+	}
+
+	double EVDDFactor::compactation() const {
+		double max_nodes = 1.0, level_nodes = 1.0;
+		for (auto pv : _domain.scope()) {
+			max_nodes += level_nodes;
+			level_nodes *= pv->size();
+		}
+		return 1.0 - node_count() / max_nodes;
+	}
+
+	EVDDFactor EVDDFactor::change_variables(unordered_map<unsigned,const Variable*> renaming) const {
+		Domain new_domain(_domain);
+		new_domain.modify_scope(renaming);
+
+		unordered_map<unsigned,unsigned> new_levels;
+		vector<pair<unsigned,unsigned>> support;
+		for (auto pv : _domain.scope()) {
+			auto it_renaming = renaming.find(pv->id());
+			unsigned l = level(pv);
+			unsigned new_l = (it_renaming != renaming.end() ? level(it_renaming->second) : l);
+			new_levels[l] = new_l;
+			support.emplace_back(l, new_l);
+		}
+		sort(support.begin(), support.end());
+		bool monotone = true;
+		for (unsigned i = 1; i < support.size(); ++i) {
+			monotone = monotone && support[i-1].second < support[i].second;
+		}
+
+		unordered_map<const Node*,Edge> cache;
+		Edge root = (monotone ? relabel(_root, new_levels, cache) : rename(_root, new_levels, cache));
+		return EVDDFactor(root, new_domain);
+	}
+
+	EVDDFactor EVDDFactor::sum_out(const Variable *variable) const {
+		vector<const Variable*> scope;
+		for (auto pv : _domain.scope()) {
+			if (pv != variable) scope.push_back(pv);
+		}
+		unordered_map<const Node*,Edge> cache;
+		EVDDFactor marginal(sum_out(_root, level(variable), cache), Domain(scope));
+		if (Profiler::enabled()) Profiler::sum_out(node_count(), marginal.node_count());
+		return marginal;
+	}
+
+	EVDDFactor EVDDFactor::sum_out(const vector<const Variable*> &variables) const {
+		EVDDFactor marginal(*this);
+		for (auto pv : variables) {
+			marginal = marginal.sum_out(pv);
+		}
+		return marginal;
+	}
+
+	EVDDFactor EVDDFactor::product(const EVDDFactor &f) const {
+		EVDDFactor prod(multiply(_root, f._root), Domain(_domain, f._domain));
+		if (Profiler::enabled()) Profiler::product(node_count() + f.node_count(), prod.node_count());
+		return prod;
+	}
+
+	EVDDFactor EVDDFactor::normalize() const {
+		Edge root { _root.weight / partition(), _root.node };
+		return EVDDFactor(root, _domain);
+	}
+
+	EVDDFactor EVDDFactor::conditioning(const unordered_map<unsigned,unsigned> &evidence) const {
+		unordered_map<unsigned,unsigned> values;
+		for (auto pv : _domain.scope()) {
+			auto it_evidence = evidence.find(pv->id());
+			if (it_evidence != evidence.end()) {
+				values[level(pv)] = it_evidence->second;
+			}
+		}
+		unordered_map<const Node*,Edge> cache;
+		if (Profiler::enabled()) Profiler::touch(node_count());
+		return EVDDFactor(restrict(_root, values, cache), Domain(_domain, evidence));
+	}
+
+	double EVDDFactor::operator[](const unordered_map<unsigned,unsigned> &instantiation) const {
+		double value = _root.weight;
+		const Node *n = _root.node;
+		while (n != &terminal && value != 0.0) {
+			const Edge &e = n->children[instantiation.at(variables[n->level]->id())];
+			value *= e.weight;
+			n = e.node;
+		}
+		return value;
+	}
+
+	vector<double> EVDDFactor::values(const Domain &domain) const {
+		vector<double> values(domain.size());
+		vector<unsigned> inst(domain.width(), 0);
+		unordered_map<unsigned,unsigned> instantiation;
+		for (unsigned i = 0; i < domain.size(); ++i) {
+			for (unsigned j = 0; j < domain.width(); ++j) {
+				instantiation[domain[j]->id()] = inst[j];
+			}
+			values[i] = (*this)[instantiation];
+			domain.next_instantiation(inst);
+		}
+		return values;
+	}
+
+	ostream &operator<<(ostream &os, const EVDDFactor &f) {
+		const Domain &domain = f.domain();
+		os << "EVDDFactor(";
+		os << "width = " << domain.width() << ", ";
+		os << "size = " << domain.size() << ", ";
+		os << "nodes = " << f.node_count() << ", ";
+		os << "compactation = " << f.compactation() * 100 << "%, ";
+		os << "partition = " << f.partition() << ")" << endl;
+		return os;
+	}
+
+}
@@ -0,0 +1,67 @@
+// Copyright (c) 2015 Thiago Pereira Bueno
+// All Rights Reserved.
+//
+// This file is part of DBN library.
+//
+// DBN is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// DBN is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DBN.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "evidence.h"
+
+#include <algorithm>
+
+using namespace std;
+
+namespace dbn {
+
+	const Evidence::value_type Evidence::MISSING;
+
+	Evidence::Evidence(const vector<unsigned> &variables, unsigned timesteps) :
+		_variables(variables),
+		_values(variables.size(), vector<value_type>(timesteps, MISSING)) {
+
+		unsigned max_id = 0;
+		for (unsigned id : variables) {
+			max_id = max(max_id, id + 1);
+		}
+		_columns.assign(max_id, -1);
+		for (unsigned i = 0; i < variables.size(); ++i) {
+			_columns[variables[i]] = i;
+		}
+	}
+
+	void Evidence::resize(unsigned timesteps) {
+		for (auto &values : _values) {
+			values.resize(timesteps, MISSING);
+		}
+	}
+
+	unordered_map<unsigned,unsigned> Evidence::observed(unsigned t) const {
+		unordered_map<unsigned,unsigned> evidence;
+		for (unsigned i = 0; i < _variables.size(); ++i) {
+			if (_values[i][t] != MISSING) {
+				evidence[_variables[i]] = _values[i][t];
+			}
+		}
+		return evidence;
+	}
+
+	size_t Evidence::memory() const {
+		size_t bytes = _variables.size() * sizeof(unsigned) + _columns.size() * sizeof(int);
+		for (auto const &values : _values) {
+			bytes += values.size() * sizeof(value_type);
+		}
+		return bytes;
+	}
+
+}
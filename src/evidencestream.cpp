@@ -0,0 +1,184 @@
+// Copyright (c) 2015 Thiago Pereira Bueno
+// All Rights Reserved.
+//
+// This file is part of DBN library.
+//
+// DBN is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// DBN is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DBN.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "evidencestream.h"
+
+#include <iostream>
+#include <cstring>
+#include <cctype>
+#include <cerrno>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace dbn {
+
+	static const char STREAM_HEADER[] = "DSTREAM";
+	static const size_t CHUNK = 1 << 16;
+
+	EvidenceStream::EvidenceStream(const char *filename) :
+		_fd(-1), _close(false), _valid(false), _buffer(CHUNK), _position(0), _size(0), _line(1), _token_line(1), _timesteps(0) {
+
+		if (strcmp(filename, "-") == 0) {
+			_fd = STDIN_FILENO;
+		}
+		else {
+			_fd = open(filename, O_RDONLY);
+			_close = true;
+		}
+		if (_fd < 0) {
+			cerr << "Error: couldn't read file " << filename << endl;
+			return;
+		}
+
+		unsigned value;
+		if (next_token(value) != WORD || _word != STREAM_HEADER) {
+			cerr << "Error: expected '" << STREAM_HEADER << "' evidence stream header in " << filename << endl;
+			return;
+		}
+
+		unsigned width, state_width;
+		if (next_token(width) != VALUE) return;
+		for (unsigned i = 0; i < width; ++i) {
+			if (next_token(value) != VALUE) return;
+			_variables.push_back(value);
+		}
+		if (next_token(state_width) != VALUE) return;
+		for (unsigned i = 0; i < state_width; ++i) {
+			if (next_token(value) != VALUE) return;
+			_state_variables.insert(value);
+		}
+		_window = Evidence(_variables, 1);
+		_valid = true;
+	}
+
+	EvidenceStream::~EvidenceStream() {
+		if (_close && _fd >= 0) close(_fd);
+	}
+
+	bool EvidenceStream::bind(const vector<const Variable*> &variables) {
+		_cardinalities.clear();
+		for (auto id : _variables) {
+			if (id >= variables.size()) {
+				cerr << "Error: evidence stream variable " << id << " is not in the model" << endl;
+				_valid = false;
+				return false;
+			}
+			_cardinalities.push_back(variables[id]->size());
+		}
+		return true;
+	}
+
+	bool EvidenceStream::next(EvidenceRow &row) {
+		if (!is_open()) return false;
+
+		unsigned width = _variables.size();
+		for (unsigned i = 0; i < width; ++i) {
+			unsigned value;
+			Token token = next_token(value);
+			if (token == VALUE && (value >= Evidence::MISSING || (!_cardinalities.empty() && value >= _cardinalities[i]))) {
+				cerr << "Error: value " << value << " out of range for variable " << _variables[i];
+				cerr << " at line " << _token_line << ", column " << i + 1 << " of the evidence stream" << endl;
+				_valid = false;
+				return false;
+			}
+			else if (token == VALUE) {
+				_window.set(0, _window.column(_variables[i]), value);
+			}
+			else if (token == MISSING) {
+				_window.set(0, _window.column(_variables[i]), Evidence::MISSING);
+			}
+			else {
+				if (token != END || i > 0) {
+					cerr << "Error: malformed or truncated evidence record at timestep " << _timesteps + 1 << endl;
+				}
+				_valid = false;
+				return false;
+			}
+		}
+		_timesteps++;
+		row = EvidenceRow { &_window, 0 };
+		return true;
+	}
+
+	bool EvidenceStream::fill() {
+		ssize_t n;
+		do {
+			n = read(_fd, _buffer.data(), _buffer.size());
+		} while (n < 0 && errno == EINTR);
+		_position = 0;
+		_size = (n > 0 ? n : 0);
+		return n > 0;
+	}
+
+	// one whitespace separated token, skipping '#' comments; tokens may
+	// straddle chunk boundaries
+	EvidenceStream::Token EvidenceStream::next_token(unsigned &value) {
+		value = 0;
+		bool comment = false;
+		while (true) {
+			if (_position == _size && !fill()) return END;
+			char c = _buffer[_position];
+			if (c == '\n') {
+				comment = false;
+				_line++;
+			}
+			if (comment || isspace(static_cast<unsigned char>(c))) {
+				_position++;
+				continue;
+			}
+			if (c == '#') {
+				comment = true;
+				_position++;
+				continue;
+			}
+			break;
+		}
+		_token_line = _line;
+
+		Token token = VALUE;
+		bool first = true;
+		_word.clear();
+		while (true) {
+			if (_position == _size && !fill()) break;
+			char c = _buffer[_position];
+			if (isspace(static_cast<unsigned char>(c))) break;
+			if (_word.size() < sizeof(STREAM_HEADER)) _word.push_back(c);
+			if (c == '*' && first) token = MISSING;
+			else if (c >= '0' && c <= '9' && token == VALUE) value = 10 * value + (c - '0');
+			else token = WORD;
+			first = false;
+			_position++;
+		}
+		return token;
+	}
+
+	bool is_evidence_stream(const char *filename) {
+		if (strcmp(filename, "-") == 0) return true;
+
+		char header[sizeof(STREAM_HEADER)] = { 0 };
+		int fd = open(filename, O_RDONLY);
+		if (fd < 0) return false;
+		ssize_t n = read(fd, header, sizeof(STREAM_HEADER) - 1);
+		close(fd);
+		return n == sizeof(STREAM_HEADER) - 1 && strcmp(header, STREAM_HEADER) == 0;
+	}
+
+}
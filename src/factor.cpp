@@ -17,6 +17,8 @@
 // along with DBN.  If not, see <http://www.gnu.org/licenses/>.
 
 #include "factor.h"
+#include "profiler.h"
+#include "memoryaccountant.h"
 
 #include <iostream>
 
@@ -26,37 +28,86 @@ namespace dbn {
 
     Factor::Factor(Domain *domain) :
         _domain(std::unique_ptr<Domain>(domain)),
-        _values(std::vector<double>(domain->size())),
-        _partition(0) { }
+        _partition(0),
+        _view(nullptr),
+        _bytes(0) {
+        MemoryAccountant::check(domain->size() * sizeof(double), "factor");
+        _values.assign(domain->size(), 0.0);
+        account();
+        if (Profiler::enabled()) Profiler::allocation();
+    }
 
     Factor::Factor(Domain *domain, double value) :
         _domain(std::unique_ptr<Domain>(domain)),
-        _values(std::vector<double>(domain->size(), value)),
-        _partition(domain->size() * value) { }
+        _partition(domain->size() * value),
+        _view(nullptr),
+        _bytes(0) {
+        MemoryAccountant::check(domain->size() * sizeof(double), "factor");
+        _values.assign(domain->size(), value);
+        account();
+        if (Profiler::enabled()) Profiler::allocation();
+    }
+
+    Factor::Factor(Domain *domain, const double *values, std::shared_ptr<const void> storage, double partition) :
+        _domain(std::unique_ptr<Domain>(domain)),
+        _partition(partition),
+        _view(values),
+        _storage(storage),
+        _bytes(0) { }
 
     Factor::Factor(double value) :
         _domain(std::unique_ptr<Domain>(new Domain)),
         _values(std::vector<double>(1, value)),
-        _partition(value) { }
+        _partition(value),
+        _view(nullptr),
+        _bytes(0) {
+        account();
+    }
 
     Factor::Factor(const Factor &f) :
         _domain(unique_ptr<Domain>(new Domain(f.domain()))),
-        _values(f._values),
-        _partition(f._partition) { }
+        _partition(f._partition),
+        _view(f._view),
+        _storage(f._storage),
+        _bytes(0) {
+        if (!f._values.empty()) {
+            MemoryAccountant::check(f._values.size() * sizeof(double), "factor");
+            _values = f._values;
+            account();
+            if (Profiler::enabled()) Profiler::allocation();
+        }
+    }
 
     Factor::Factor(Factor &&f) {
         _domain = move(f._domain);
-        _values = f._values;
+        _values = move(f._values);
         _partition = f._partition;
+        _view = f._view;
+        _storage = move(f._storage);
+        _bytes = f._bytes;
+        f._values.clear();
+        f._view = nullptr;
+        f._partition = 0.0;
+        f._bytes = 0;
+    }
+
+    Factor::~Factor() {
+        MemoryAccountant::release(_bytes);
     }
 
     Factor &Factor::operator=(Factor &&f) {
         if (this != &f) {
+            MemoryAccountant::release(_bytes);
             _domain = move(f._domain);
-            _values = f._values;
+            _values = move(f._values);
             _partition = f._partition;
+            _view = f._view;
+            _storage = move(f._storage);
+            _bytes = f._bytes;
             f._values.clear();
+            f._view = nullptr;
             f._partition = 0.0;
+            f._bytes = 0;
         }
         return *this;
     }
@@ -70,18 +121,41 @@ namespace dbn {
     }
 
     const double &Factor::operator[](unsigned i) const {
-        if (i < size()) return _values[i];
+        if (i < size()) return (_view ? _view[i] : _values[i]);
         else throw "Factor::operator[]: Index out of range.";
     }
 
     double &Factor::operator[](unsigned i) { 
-        if (i < size()) return _values[i];
+        if (i < size()) return writable_values()[i];
         else throw "Factor::operator[]: Index out of range.";
     }
 
+    double *Factor::writable_values() {
+        if (_view) {
+            MemoryAccountant::check(size() * sizeof(double), "factor");
+            _values.assign(_view, _view + size());
+            _view = nullptr;
+            _storage.reset();
+            account();
+        }
+        return _values.data();
+    }
+
+    // the values table counts against the memory budget until the factor
+    // is destroyed (or its table moved to another factor)
+    void Factor::account() {
+        MemoryAccountant::release(_bytes);
+        _bytes = _values.capacity() * sizeof(double);
+        MemoryAccountant::allocate(_bytes);
+    }
+
     double Factor::operator[](std::vector<unsigned> inst) const {
         unsigned pos = _domain->position_instantiation(inst);
-        return _values[pos];
+        return (*this)[pos];
+    }
+
+    size_t Factor::memory() const {
+        return sizeof(Factor) + _domain->memory() + _values.capacity() * sizeof(double);
     }
 
     bool Factor::in_scope(const Variable *variable) const {
@@ -124,6 +198,7 @@ namespace dbn {
             }
             new_factor._partition = partition;
 
+            if (Profiler::enabled()) Profiler::sum_out(size(), factor_size);
             return new_factor;
         }
     }
@@ -132,6 +207,15 @@ namespace dbn {
         const Domain &d1 = this->domain();
         const Domain &d2 = f.domain();
 
+        // predicted size of the product, before its domain is built
+        if (MemoryAccountant::limit()) {
+            double entries = d1.size();
+            for (unsigned i = 0; i < d2.width(); ++i) {
+                if (!d1.in_scope(d2[i])) entries *= d2[i]->size();
+            }
+            MemoryAccountant::check(entries * sizeof(double), "factor product");
+        }
+
         Domain *new_domain = new Domain(d1, d2);
         unsigned width = new_domain->width();
         unsigned size = new_domain->size();
@@ -153,6 +237,8 @@ namespace dbn {
             new_domain->next_instantiation(inst);
         }
         new_factor._partition = partition;
+
+        if (Profiler::enabled()) Profiler::product(size, size);
         return new_factor;
     }
 
@@ -160,11 +246,13 @@ namespace dbn {
         Factor new_factor(*this);
 
         unsigned sz = new_factor.size();
+        double *values = new_factor.writable_values();
         for (unsigned i = 0; i < sz; ++i) {
-            new_factor._values[i] = new_factor._values[i]/new_factor._partition;
+            values[i] = values[i]/new_factor._partition;
         }
         new_factor._partition = 1.0;
 
+        if (Profiler::enabled()) Profiler::touch(sz);
         return new_factor;
     }
 
@@ -193,6 +281,8 @@ namespace dbn {
         }
         new_factor._partition = partition;
 
+        if (Profiler::enabled()) Profiler::touch(new_factor_size);
+
         return new_factor;
     }
 
@@ -227,4 +317,15 @@ namespace dbn {
         return os;
     }
 
+    vector<double> Factor::values(const Domain &domain) const {
+        vector<unsigned> positions = index_map(domain, *_domain);
+        unsigned size = positions.size();
+        vector<double> values(size);
+        const double *data = (_view ? _view : _values.data());
+        for (unsigned i = 0; i < size; ++i) {
+            values[i] = data[positions[i]];
+        }
+        return values;
+    }
+
 }
@@ -0,0 +1,313 @@
+// Copyright (c) 2015 Thiago Pereira Bueno
+// All Rights Reserved.
+//
+// This file is part of DBN library.
+//
+// DBN is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// DBN is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DBN.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "generator.h"
+#include "io.h"
+#include "domain.h"
+
+#include <vector>
+#include <set>
+#include <algorithm>
+#include <functional>
+
+using namespace std;
+
+namespace dbn {
+
+	static shared_ptr<Factor> make_factor(Model &model, const vector<unsigned> &ids, const vector<double> &values) {
+		vector<const Variable*> scope;
+		for (unsigned id : ids) {
+			scope.push_back(model.variables[id].get());
+		}
+		shared_ptr<Factor> factor = make_shared<Factor>(new Domain(scope));
+		double partition = 0.0;
+		for (unsigned i = 0; i < values.size(); ++i) {
+			(*factor)[i] = values[i];
+			partition += values[i];
+		}
+		factor->partition(partition);
+		return factor;
+	}
+
+	// CPT of ids[0] given the other variables; each conditional distribution
+	// keeps at least one nonzero entry
+	static shared_ptr<Factor> random_cpt(Model &model, const vector<unsigned> &ids, double sparsity, mt19937 &generator) {
+		uniform_real_distribution<double> uniform(0.0, 1.0);
+		unsigned k = model.variables[ids[0]]->size();
+		unsigned configurations = 1;
+		for (unsigned i = 1; i < ids.size(); ++i) {
+			configurations *= model.variables[ids[i]]->size();
+		}
+
+		vector<double> values(k * configurations);
+		for (unsigned p = 0; p < configurations; ++p) {
+			double total = 0.0;
+			for (unsigned c = 0; c < k; ++c) {
+				double value = (uniform(generator) < sparsity ? 0.0 : uniform(generator));
+				values[c * configurations + p] = value;
+				total += value;
+			}
+			if (total == 0.0) {
+				unsigned c = uniform_int_distribution<unsigned>(0, k-1)(generator);
+				values[c * configurations + p] = total = 1.0;
+			}
+			for (unsigned c = 0; c < k; ++c) {
+				values[c * configurations + p] /= total;
+			}
+		}
+		return make_factor(model, ids, values);
+	}
+
+	static void complete_model(Model &model) {
+		unsigned internals_order;
+		read_internals_model(model.variables, internals_order, model.interface, model.sensor, model.internals);
+		read_forward_interface(model.factors, model.transition, model.forward_interface);
+	}
+
+	void generate_dc(Model &model, unsigned inputs, unsigned gates, unsigned health, mt19937 &generator) {
+		if (inputs < 2 || gates < 1 || health < 1) {
+			throw "generate_dc: at least 2 inputs, 1 gate and 1 health variable are required.";
+		}
+		uniform_real_distribution<double> uniform(0.0, 1.0);
+
+		// inputs, gates, then (current, next) health pairs, all binary
+		unsigned total = inputs + gates + 2*health;
+		for (unsigned id = 0; id < total; ++id) {
+			model.variables.emplace_back(new Variable(id, 2));
+		}
+		for (unsigned j = 0; j < health; ++j) {
+			unsigned curr = inputs + gates + 2*j;
+			model.prior.insert(curr);
+			model.interface.insert(curr);
+			model.interface.insert(curr+1);
+			model.transition[curr+1] = model.variables[curr].get();
+			model.state_variables.insert(curr);
+		}
+		for (unsigned i = 0; i < inputs; ++i) {
+			model.sensor.insert(i);
+		}
+		model.sensor.insert(inputs+gates-1);
+
+		// scopes: each gate reads an input wire (round robin) and, for
+		// and/or gates, any earlier wire; gate faults are shared round robin
+		vector<vector<unsigned>> scopes;
+		for (unsigned i = 0; i < inputs; ++i) {
+			scopes.push_back({ i });
+		}
+
+		vector<unsigned> health_vars(health), input_vars(inputs);
+		for (unsigned j = 0; j < health; ++j) health_vars[j] = j;
+		for (unsigned i = 0; i < inputs; ++i) input_vars[i] = i;
+		shuffle(health_vars.begin(), health_vars.end(), generator);
+		shuffle(input_vars.begin(), input_vars.end(), generator);
+
+		unsigned health_index = 0, input_index = 0;
+		for (unsigned j = inputs; j < inputs+gates-1; ++j) {
+			vector<unsigned> scope = { j };
+			unsigned fan_in = (uniform_int_distribution<unsigned>(1, 3)(generator) == 3 ? 1 : 2);
+
+			scope.push_back(input_vars[input_index]);
+			input_index = (input_index + 1) % inputs;
+			if (fan_in == 2) {
+				uniform_int_distribution<unsigned> wire(0, j-1);
+				unsigned gate_input = wire(generator);
+				while (gate_input == scope.back()) {
+					gate_input = wire(generator);
+				}
+				scope.push_back(gate_input);
+			}
+
+			scope.push_back(inputs + gates + 2*health_vars[health_index]);
+			health_index = (health_index + 1) % health;
+			scopes.push_back(scope);
+		}
+
+		// last gate is the output of the circuit
+		unsigned j = inputs+gates-1;
+		scopes.push_back({ j, j-1, j-2, inputs + gates + 2*health_vars[health_index] });
+
+		for (unsigned k = inputs+gates; k < total; ++k) {
+			if ((k - inputs - gates) % 2 == 0) scopes.push_back({ k });
+			else scopes.push_back({ k, k-1 });
+		}
+
+		// factors
+		for (unsigned i = 0; i < inputs; ++i) {
+			double p = uniform(generator);
+			model.factors.push_back(make_factor(model, scopes[i], { p, 1-p }));
+		}
+
+		// a faulty gate (health 0) outputs a fair coin
+		for (unsigned j = inputs; j < inputs+gates; ++j) {
+			const vector<unsigned> &scope = scopes[j];
+			unsigned width = scope.size();
+			bool conjunction = (uniform(generator) < 0.5);
+
+			vector<double> values(1u << width);
+			for (unsigned l = 0; l < values.size(); ++l) {
+				vector<bool> instantiation(width);
+				for (unsigned d = 0; d < width; ++d) {
+					instantiation[d] = (l >> (width-1-d)) & 1;
+				}
+				if (!instantiation[width-1]) {
+					values[l] = 0.5;
+				}
+				else {
+					bool output;
+					if (width == 3) output = !instantiation[1];
+					else if (conjunction) output = instantiation[1] && instantiation[2];
+					else output = instantiation[1] || instantiation[2];
+					values[l] = (instantiation[0] == output ? 1.0 : 0.0);
+				}
+			}
+			model.factors.push_back(make_factor(model, scope, values));
+		}
+
+		for (unsigned k = inputs+gates; k < total; ++k) {
+			if ((k - inputs - gates) % 2 == 0) {
+				double p = uniform(generator);
+				model.factors.push_back(make_factor(model, scopes[k], { p, 1-p }));
+			}
+			else {
+				double p1 = uniform(generator);
+				double p2 = uniform(generator);
+				model.factors.push_back(make_factor(model, scopes[k], { p1, p2, 1-p1, 1-p2 }));
+			}
+		}
+
+		complete_model(model);
+	}
+
+	void generate_random_dbn(Model &model, const RandomDBN &parameters, mt19937 &generator) {
+		unsigned n = parameters.interface;
+		unsigned parents = min(max(parameters.parents, 1u), n);
+		unsigned sensors = parameters.sensors;
+
+		// current state 0..n-1, next state n..2n-1, then sensors
+		for (unsigned id = 0; id < 2*n + sensors; ++id) {
+			model.variables.emplace_back(new Variable(id, parameters.cardinality));
+		}
+		for (unsigned i = 0; i < n; ++i) {
+			model.prior.insert(i);
+			model.interface.insert(i);
+			model.interface.insert(n+i);
+			model.transition[n+i] = model.variables[i].get();
+			model.state_variables.insert(i);
+		}
+		for (unsigned i = 0; i < sensors; ++i) {
+			model.sensor.insert(2*n + i);
+		}
+
+		for (unsigned i = 0; i < n; ++i) {
+			model.factors.push_back(random_cpt(model, { i }, parameters.sparsity, generator));
+		}
+		for (unsigned i = 0; i < n; ++i) {
+			// window of parents centered on the same variable
+			unsigned first = (i < (parents-1)/2 ? 0 : i - (parents-1)/2);
+			first = min(first, n - parents);
+			vector<unsigned> scope = { n+i };
+			for (unsigned j = first; j < first + parents; ++j) {
+				scope.push_back(j);
+			}
+			model.factors.push_back(random_cpt(model, scope, parameters.sparsity, generator));
+		}
+		for (unsigned i = 0; i < sensors; ++i) {
+			model.factors.push_back(random_cpt(model, { 2*n + i, i % n }, parameters.sparsity, generator));
+		}
+
+		complete_model(model);
+	}
+
+	// value of the child of cpt given the values of its parents
+	static unsigned sample(const Factor &cpt, const vector<unsigned> &values, mt19937 &generator) {
+		const Domain &domain = cpt.domain();
+		unsigned position = 0;
+		for (unsigned i = 1; i < domain.width(); ++i) {
+			position += values[domain[i]->id()] * domain.offset(i);
+		}
+
+		unsigned k = domain[(unsigned)0]->size();
+		unsigned stride = domain.offset(0);
+		double total = 0.0;
+		for (unsigned c = 0; c < k; ++c) {
+			total += cpt[c * stride + position];
+		}
+
+		double u = uniform_real_distribution<double>(0.0, total)(generator);
+		unsigned value = 0;
+		for (unsigned c = 0; c < k; ++c) {
+			double p = cpt[c * stride + position];
+			if (p == 0.0) continue;
+			value = c;
+			u -= p;
+			if (u < 0.0) break;
+		}
+		return value;
+	}
+
+	Evidence sample_observations(const Model &model, unsigned timesteps, mt19937 &generator) {
+		vector<unsigned> sensors(model.sensor.begin(), model.sensor.end());
+		Evidence observations(sensors, timesteps);
+
+		unsigned n = model.variables.size();
+		vector<unsigned> values(n, 0);
+		vector<bool> known(n);
+
+		// sample variables in topological order, as their parents are known
+		auto sample_ready = [&](function<bool(unsigned)> eligible) {
+			bool changed = true;
+			while (changed) {
+				changed = false;
+				for (unsigned id = 0; id < n; ++id) {
+					if (known[id] || !eligible(id)) continue;
+					const Factor &cpt = *model.factors[id];
+					const Domain &domain = cpt.domain();
+					bool ready = true;
+					for (unsigned i = 1; i < domain.width(); ++i) {
+						ready = ready && known[domain[i]->id()];
+					}
+					if (ready) {
+						values[id] = sample(cpt, values, generator);
+						known[id] = true;
+						changed = true;
+					}
+				}
+			}
+		};
+
+		for (unsigned t = 0; t < timesteps; ++t) {
+			fill(known.begin(), known.end(), false);
+			if (t > 0) {
+				for (auto it_transition : model.transition) {
+					unsigned curr = it_transition.second->id();
+					values[curr] = values[it_transition.first];
+					known[curr] = true;
+				}
+			}
+
+			sample_ready([&model](unsigned id) { return !model.transition.count(id); });
+			for (unsigned i = 0; i < sensors.size(); ++i) {
+				observations.set(t, observations.column(sensors[i]), values[sensors[i]]);
+			}
+			sample_ready([&model](unsigned id) { return model.transition.count(id) > 0; });
+		}
+
+		return observations;
+	}
+
+}
@@ -18,72 +18,147 @@
 
 #include "graph.h"
 
+#include <set>
+#include <tuple>
+#include <algorithm>
+
 using namespace std;
 
 namespace dbn {
 
-	Graph::Graph(const vector<shared_ptr<Factor>> &factors)
+	Graph::Graph(const vector<vector<const Variable*>> &scopes) : _induced_width(0)
 	{
-		for (auto &pf : factors) {
-			const Domain &domain = pf->domain();
-			unsigned width = domain.width();
-			if (width == 0) continue;
-			for (unsigned i = 0; i < width-1; ++i) {
-				for (unsigned j = i+1; j < width; ++j) {
-					const Variable *v1 = domain[i];
-					const Variable *v2 = domain[j];
-					_adj[v1].insert(v2);
-					_adj[v2].insert(v1);
-				}
-			}
+		for (auto const &scope : scopes) {
+			add_clique(scope);
 		}
 	}
 
 	vector<const Variable*>
-	Graph::ordering(const vector<const Variable*> &variables)
+	Graph::ordering(const vector<const Variable*> &variables, Heuristic heuristic)
 	{
-		vector<const Variable*> vars(variables);
+		Adjacency adj(_adj);
+		for (auto pv : variables) {
+			adj[pv];
+		}
+
+		// priority queue keyed by (score, id) supporting score updates
+		set<tuple<double,unsigned,const Variable*>> queue;
+		unordered_map<const Variable*,double> scores;
+		for (auto pv : variables) {
+			double s = score(adj, pv, heuristic);
+			scores[pv] = s;
+			queue.emplace(s, pv->id(), pv);
+		}
+
+		_induced_width = 0;
+
 		vector<const Variable*> ordering;
-		unordered_set<const Variable*> processed;
-		while (vars.size() > 0) {
-			unsigned min_index = min_fill(vars, processed);
-			const Variable *next_var = vars[min_index];
-			ordering.push_back(next_var);
-			processed.insert(next_var);
-			vars.erase(vars.begin()+min_index);
+		while (!queue.empty()) {
+			const Variable *var = get<2>(*queue.begin());
+			queue.erase(queue.begin());
+			scores.erase(var);
+			ordering.push_back(var);
+
+			vector<const Variable*> neighbors(adj[var].begin(), adj[var].end());
+			unsigned degree = neighbors.size();
+			_induced_width = max(_induced_width, degree);
+
+			// connect neighbors with fill-in edges and remove var
+			for (unsigned i = 0; i < degree; ++i) {
+				adj[neighbors[i]].erase(var);
+				for (unsigned j = i+1; j < degree; ++j) {
+					if (adj[neighbors[i]].insert(neighbors[j]).second) {
+						adj[neighbors[j]].insert(neighbors[i]);
+					}
+				}
+			}
+			adj.erase(var);
+
+			// rescore variables whose neighborhood changed
+			unordered_set<const Variable*> affected(neighbors.begin(), neighbors.end());
+			if (heuristic != MIN_DEGREE) {
+				for (auto pv : neighbors) {
+					affected.insert(adj[pv].begin(), adj[pv].end());
+				}
+			}
+			for (auto pv : affected) {
+				unordered_map<const Variable*,double>::iterator it_score = scores.find(pv);
+				if (it_score == scores.end()) continue;
+				queue.erase(make_tuple(it_score->second, pv->id(), pv));
+				it_score->second = score(adj, pv, heuristic);
+				queue.emplace(it_score->second, pv->id(), pv);
+			}
 		}
+
 		return ordering;
 	}
 
-	unsigned
-	Graph::min_fill(std::vector<const Variable*> &variables, unordered_set<const Variable*> &processed)
+	double
+	Graph::score(const Adjacency &adj, const Variable *variable, Heuristic heuristic)
 	{
-		unsigned min_index = 0;
-		unsigned min_fill = _adj.size();
-
-		unsigned nvars = variables.size();
-		for (unsigned i = 0; i < nvars; ++i) {
-			const Variable *var = variables[i];
-			unordered_set<const Variable*> neighboors = _adj[var];
-
-			unsigned fill_in = 0;
-			for (auto const v1 : neighboors) {
-				if (processed.count(v1)) continue;
-				for (auto const v2 : neighboors) {
-					if (processed.count(v2) || v1->id() >= v2->id()) continue;
-					if (!_adj[v1].count(v2)) {
-						fill_in++;
-					}
-				}
+		Adjacency::const_iterator it_adj = adj.find(variable);
+		if (it_adj == adj.end()) return 0.0;
+		const unordered_set<const Variable*> &neighbors = it_adj->second;
+
+		if (heuristic == MIN_DEGREE) return neighbors.size();
+
+		double fill_in = 0.0;
+		for (auto const v1 : neighbors) {
+			const unordered_set<const Variable*> &adj1 = adj.find(v1)->second;
+			for (auto const v2 : neighbors) {
+				if (v1->id() >= v2->id() || adj1.count(v2)) continue;
+				fill_in += (heuristic == WEIGHTED_MIN_FILL ? 1.0 * v1->size() * v2->size() : 1.0);
 			}
+		}
+		return fill_in;
+	}
 
-			if (fill_in < min_fill) {
-				min_index = i;
-				min_fill = fill_in;
+	unsigned
+	Graph::induced_width(const vector<const Variable*> &ordering) const
+	{
+		unsigned width = 0;
+		for (auto const &clique : cliques(ordering)) {
+			width = max(width, (unsigned) clique.size() - 1);
+		}
+		return width;
+	}
+
+	void
+	Graph::add_clique(const vector<const Variable*> &variables)
+	{
+		unsigned width = variables.size();
+		for (unsigned i = 0; i < width; ++i) {
+			_adj[variables[i]];
+			for (unsigned j = i+1; j < width; ++j) {
+				_adj[variables[i]].insert(variables[j]);
+				_adj[variables[j]].insert(variables[i]);
 			}
 		}
+	}
+
+	vector<vector<const Variable*>>
+	Graph::cliques(const vector<const Variable*> &ordering) const
+	{
+		// eliminate variables in order, adding fill-in edges to a copy of the graph
+		unordered_map<const Variable*,unordered_set<const Variable*>> adj(_adj);
 
-		return min_index;
+		vector<vector<const Variable*>> cliques;
+		for (auto var : ordering) {
+			vector<const Variable*> clique(1, var);
+			for (auto pv : adj[var]) {
+				clique.push_back(pv);
+			}
+			for (unsigned i = 1; i < clique.size(); ++i) {
+				adj[clique[i]].erase(var);
+				for (unsigned j = i+1; j < clique.size(); ++j) {
+					adj[clique[i]].insert(clique[j]);
+					adj[clique[j]].insert(clique[i]);
+				}
+			}
+			adj.erase(var);
+			cliques.push_back(clique);
+		}
+		return cliques;
 	}
 
 	std::ostream &
@@ -95,7 +170,7 @@ namespace dbn {
 			unordered_set<const Variable*> neighboors = it.second;
 			os << v->id() << " :";
 			for (auto pv : neighboors) {
-				cout << " " << pv->id();
+				os << " " << pv->id();
 			}
 			os << endl;
 		}
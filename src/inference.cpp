@@ -18,6 +18,12 @@
 
 #include "inference.h"
 #include "graph.h"
+#include "junctiontree.h"
+#include "planner.h"
+#include "profiler.h"
+#include "memoryaccountant.h"
+#include "sensorcache.h"
+#include "densehmm.h"
 
 #include <forward_list>
 #include <set>
@@ -28,23 +34,84 @@ using namespace std;
 
 namespace dbn {
 
-	Factor variable_elimination(
-		vector<const Variable*> &variables,
-		vector<shared_ptr<Factor>> &factors) {
+	// configuration only; the state of a run lives in its FilteringRun
+	static Graph::Heuristic elimination_heuristic = Graph::MIN_FILL;
+	static unsigned sensor_cache_capacity = 256;
+	static bool sensor_cache_prewarm = false;
+	static unsigned dense_limit = 1024;
+	static long reordering_threshold = 0;
+	static double approximation_epsilon = 0.0;
+
+	EvidenceSource replay(const Evidence &observations) {
+		auto t = make_shared<unsigned>(0);
+		return [&observations, t](EvidenceRow &row) {
+			if (*t == observations.timesteps()) return false;
+			row = EvidenceRow { &observations, (*t)++ };
+			return true;
+		};
+	}
 
-		// initialize result
-		Factor result(1.0);
+	void set_elimination_heuristic(Graph::Heuristic heuristic) {
+		elimination_heuristic = heuristic;
+	}
+
+	void set_sensor_cache(unsigned capacity, bool prewarm) {
+		sensor_cache_capacity = capacity;
+		sensor_cache_prewarm = prewarm;
+	}
+
+	void set_dense_limit(unsigned states) {
+		dense_limit = states;
+	}
 
-		// choose elimination ordering
+	void set_reordering_threshold(long nodes) {
+		reordering_threshold = nodes;
+	}
+
+	void set_approximation(double epsilon) {
+		approximation_epsilon = epsilon;
+	}
+
+	template<class T>
+	vector<vector<const Variable*>> scopes(const vector<shared_ptr<T>> &factors) {
+		vector<vector<const Variable*>> factor_scopes;
+		for (auto const &pf : factors) {
+			factor_scopes.push_back(pf->domain().scope());
+		}
+		return factor_scopes;
+	}
+
+	vector<const Variable*> elimination_ordering(
+		FilteringRun &run,
+		const string &name,
+		const vector<const Variable*> &variables,
+		const vector<vector<const Variable*>> &scopes) {
+
+		// graph heuristic ordering, refined by the cost-based planner if any
+		Graph g(scopes);
+		vector<const Variable*> ordering = g.ordering(variables, elimination_heuristic);
+		if (run.planner) {
+			ordering = run.planner->ordering(name, variables, scopes, ordering);
+		}
+		run.induced_width = max(run.induced_width, g.induced_width(ordering));
+		return ordering;
+	}
+
+	template<class T>
+	static vector<shared_ptr<T>> bucket_elimination(
+		const vector<const Variable*> &variables,
+		const vector<shared_ptr<T>> &factors) {
+
+		// factors not mentioning any eliminated variable
+		vector<shared_ptr<T>> remaining;
+
+		// eliminate in the ordering chosen by the caller
 		forward_list<const Variable*> ordering(variables.begin(), variables.end());
-		// Graph g(factors);
-		// vector<const Variable*> new_ordering = g.ordering(variables);
-		// forward_list<const Variable*> ordering(new_ordering.begin(), new_ordering.end());
 
 		// initialize buckets
-		unordered_map<unsigned,set<shared_ptr<Factor>>> buckets;
+		unordered_map<unsigned,set<shared_ptr<T>>> buckets;
 		for (auto pv : ordering) {
-			set<shared_ptr<Factor>> bfactors;
+			set<shared_ptr<T>> bfactors;
 			buckets[pv->id()] = bfactors;
 		}
 		for (auto pf : factors) {
@@ -57,7 +124,7 @@ namespace dbn {
 				}
 			}
 			if (!in_bucket) {
-				result *= *pf;
+				remaining.push_back(pf);
 			}
 		}
 
@@ -67,18 +134,12 @@ namespace dbn {
 			ordering.pop_front();
 
 			// eliminate var
-			Factor prod(1.0);
+			T prod(1.0);
 			for (auto pf : buckets[var->id()]) {
 				prod *= *pf;
 			}
-			shared_ptr<Factor> new_factor = make_shared<Factor>(prod.sum_out(var));
-
-			// stop if finished
-			if (buckets.empty()) {
-				result *= *new_factor;
-				// cout << *result << endl;
-				break;
-			}
+			buckets.erase(var->id());
+			shared_ptr<T> new_factor = make_shared<T>(prod.sum_out(var));
 
 			// update bucket list with new factor
 			bool in_bucket = false;
@@ -90,62 +151,113 @@ namespace dbn {
 				}
 			}
 			if (!in_bucket) {
-				result *= *new_factor;
+				remaining.push_back(new_factor);
 			}
 		}
 
+		return remaining;
+	}
+
+	template<class T>
+	T variable_elimination(
+		vector<const Variable*> &variables,
+		vector<shared_ptr<T>> &factors) {
+
+		T result(1.0);
+		for (auto pf : bucket_elimination<T>(variables, factors)) {
+			result *= *pf;
+		}
 		return result;
 	}
 
-	Factor project(
-		vector<shared_ptr<Factor>> &factors,
-		const unordered_map<unsigned,const Variable*> &transition,
-		const Factor &forward) {
+	// takes the factor by value, so that callers move a belief state in
+	// and nothing is copied when there is no variable to sum out
+	template<class T>
+	T marginalize(T factor, const vector<const Variable*> &variables) {
+		for (auto pv : variables) {
+			factor = factor.sum_out(pv);
+		}
+		return factor;
+	}
 
-		static vector<const Variable*> ordering;
-		static vector<shared_ptr<Factor>> sum_prod_factors;
+	// transition model of a filtering run and its elimination ordering,
+	// built once per run from the factors of its model
+	template<class T>
+	void transition_model(
+		FilteringRun &run,
+		vector<shared_ptr<T>> &factors,
+		const unordered_map<unsigned,const Variable*> &transition,
+		const T &forward,
+		vector<const Variable*> &ordering,
+		vector<shared_ptr<T>> &sum_prod_factors) {
 
-		if (ordering.size() == 0 && sum_prod_factors.size() == 0) {
-			for (auto it_transition : transition) {
-				unsigned id_prime = it_transition.first;
-				const Variable *variable = it_transition.second;
-				ordering.push_back(variable);
-				sum_prod_factors.push_back(factors[id_prime]);
-			}
+		ordering.clear();
+		sum_prod_factors.clear();
+		for (auto it_transition : transition) {
+			ordering.push_back(it_transition.second);
+			sum_prod_factors.push_back(factors[it_transition.first]);
 		}
+		sum_prod_factors.push_back(make_shared<T>(forward));
+		ordering = elimination_ordering(run, "project", ordering, scopes(sum_prod_factors));
+		sum_prod_factors.pop_back();
+	}
+
+	template<class T>
+	T project(
+		vector<const Variable*> &ordering,
+		vector<shared_ptr<T>> &sum_prod_factors,
+		const unordered_map<unsigned,const Variable*> &transition,
+		const T &forward) {
 
 		// variable elimination
-		sum_prod_factors.push_back(make_shared<Factor>(forward));
-		Factor projection = variable_elimination(ordering, sum_prod_factors);
+		sum_prod_factors.push_back(make_shared<T>(forward));
+		T projection = variable_elimination(ordering, sum_prod_factors);
 		projection = projection.change_variables(transition);
 		sum_prod_factors.pop_back();
 
 		return projection;
 	}
 
-	Factor update(
-		const Factor &projection,
-		const Factor &sensor_model,
-		const unordered_map<unsigned,unsigned> &evidence) {
+	template<class T>
+	T update(
+		const T &projection,
+		const T &evidence_t) {
 
-		// add observation from time t
-		Factor evidence_t = sensor_model.conditioning(evidence);
-
-		// update projection with observation
-		Factor belief_state = evidence_t * projection;
+		// update projection with observation from time t
+		ScopedPhase phase(Profiler::UPDATE);
+		T belief_state = evidence_t.product(projection);
 
 		// return move(belief_state);
+		phase.next(Profiler::NORMALIZATION);
 		return belief_state.normalize();
 	}
 
 	vector<shared_ptr<Factor>> filtering(
 		vector<const Variable*> &variables, vector<shared_ptr<Factor>> &factors,
 		set<unsigned> &prior, set<unsigned> &sensor, set<unsigned> &internals,
-		unordered_map<unsigned,const Variable*> &transition,
-		vector<unordered_map<unsigned,unsigned>> &observations) {
+		unordered_map<unsigned,const Variable*> &transition, set<unsigned> &forward_interface,
+		const Evidence &observations,
+		FilteringRun *run) {
 
-		// estimates
 		vector<shared_ptr<Factor>> estimates;
+		filtering(variables, factors, prior, sensor, internals, transition, forward_interface, replay(observations),
+			[&estimates](const Factor &belief_state) { estimates.push_back(make_shared<Factor>(belief_state)); }, run);
+		return estimates;
+	}
+
+	unsigned filtering(
+		vector<const Variable*> &variables, vector<shared_ptr<Factor>> &factors,
+		set<unsigned> &prior, set<unsigned> &sensor, set<unsigned> &internals,
+		unordered_map<unsigned,const Variable*> &transition, set<unsigned> &forward_interface,
+		EvidenceSource next, EstimateSink<Factor> estimate,
+		FilteringRun *run) {
+
+		// statistics of this run, discarded when the caller passes none
+		FilteringRun discarded;
+		FilteringRun &session = run ? *run : discarded;
+
+		unsigned steps = 0;
+		EvidenceRow evidence { nullptr, 0 };
 
 		// prior model
 		Factor prior_model(1.0);
@@ -165,38 +277,197 @@ namespace dbn {
 		for (auto id : internals) {
 			internal_variables.push_back(variables[id]);
 		}
+		ScopedPhase phase(Profiler::SENSOR_MODEL);
+		internal_variables = elimination_ordering(session, "sensor", internal_variables, scopes(sensor_factors));
 		Factor sensor_model = variable_elimination(internal_variables, sensor_factors);
+		phase.stop();
+
+		// dense fast path when the joint interface is small and its
+		// transition matrix fits the memory budget
+		double states = DenseHMM::states(transition);
+		session.dense_fast_path = (states <= dense_limit && MemoryAccountant::available(DenseHMM::matrix_bytes(states)));
+		if (session.dense_fast_path) {
+			phase.next(Profiler::SENSOR_MODEL);
+			DenseHMM hmm(variables, factors, transition, sensor_model);
+			phase.stop();
+			SensorCache<DenseHMM,vector<double>> likelihoods(hmm, sensor_cache_capacity);
+			if (sensor_cache_prewarm) {
+				phase.next(Profiler::SENSOR_MODEL);
+				likelihoods.prewarm(sensor);
+				phase.stop();
+			}
+
+			unsigned size = hmm.size();
+			vector<double> forward = hmm.vectorize(prior_model);
+			vector<double> projection(size);
+			Profiler::end_setup();
+			while (next(evidence)) {
+				phase.next(Profiler::PROJECTION);
+				hmm.project(forward.data(), projection.data());
+
+				phase.next(Profiler::CONDITIONING);
+				const vector<double> &likelihood = likelihoods(evidence);
+
+				phase.next(Profiler::UPDATE);
+				double partition = 0.0;
+				for (unsigned i = 0; i < size; ++i) {
+					forward[i] = projection[i] * likelihood[i];
+					partition += forward[i];
+				}
+
+				phase.next(Profiler::NORMALIZATION);
+				for (unsigned i = 0; i < size; ++i) {
+					forward[i] /= partition;
+				}
+				if (Profiler::enabled()) Profiler::touch(2.0 * size * size + 2.0 * size);
+
+				phase.next(Profiler::OUTPUT);
+				estimate(hmm.factor(forward));
+				steps++;
+
+				phase.stop();
+				Profiler::end_step();
+			}
+
+			session.sensor_cache_hits = likelihoods.hits();
+			session.sensor_cache_misses = likelihoods.misses();
+
+			return steps;
+		}
+
+		// slice variables outside the forward interface
+		vector<const Variable*> dropped;
+		for (auto it_transition : transition) {
+			const Variable *curr = it_transition.second;
+			if (!forward_interface.count(curr->id())) {
+				dropped.push_back(curr);
+			}
+		}
+
+		// sensor model conditioned on evidence, memoized by observation
+		SensorCache<Factor> likelihoods(sensor_model, sensor_cache_capacity);
+		if (sensor_cache_prewarm) {
+			phase.next(Profiler::SENSOR_MODEL);
+			likelihoods.prewarm(sensor);
+			phase.stop();
+		}
 
 		// initialize forward message
-		Factor forward = prior_model;
+		Factor forward = marginalize(move(prior_model), dropped);
+
+		// transition model and its elimination ordering
+		vector<const Variable*> ordering;
+		vector<shared_ptr<Factor>> sum_prod_factors;
+		transition_model(session, factors, transition, forward, ordering, sum_prod_factors);
 
-		for (auto evidence : observations) {
+		Profiler::end_setup();
+		while (next(evidence)) {
 			// project belief state
-			Factor projection = project(factors, transition, forward);
+			phase.next(Profiler::PROJECTION);
+			Factor projection = project(ordering, sum_prod_factors, transition, forward);
 
 			// update belief state
-			forward = update(projection, sensor_model, evidence);
-
-			// add new estimate to filtering list
-			estimates.push_back(make_shared<Factor>(forward));
+			phase.next(Profiler::CONDITIONING);
+			const Factor &likelihood = likelihoods(evidence);
+			phase.stop();
+			Factor belief_state = update(projection, likelihood);
+
+			// hand the new estimate over
+			phase.next(Profiler::OUTPUT);
+			estimate(belief_state);
+			steps++;
+
+			// carry the forward interface only
+			phase.next(Profiler::PROJECTION);
+			forward = marginalize(move(belief_state), dropped);
+
+			phase.stop();
+			Profiler::end_step();
 		}
 
+		session.sensor_cache_hits = likelihoods.hits();
+		session.sensor_cache_misses = likelihoods.misses();
+
+		return steps;
+	}
+
+	vector<shared_ptr<Factor>> junction_tree_filtering(
+		vector<const Variable*> &variables, vector<shared_ptr<Factor>> &factors,
+		set<unsigned> &prior, set<unsigned> &sensor, set<unsigned> &internals,
+		unordered_map<unsigned,const Variable*> &transition,
+		const Evidence &observations,
+		FilteringRun *run) {
+
+		vector<shared_ptr<Factor>> estimates;
+		junction_tree_filtering(variables, factors, prior, sensor, internals, transition, replay(observations),
+			[&estimates](const Factor &belief_state) { estimates.push_back(make_shared<Factor>(belief_state)); }, run);
 		return estimates;
 	}
 
+	unsigned junction_tree_filtering(
+		vector<const Variable*> &variables, vector<shared_ptr<Factor>> &factors,
+		set<unsigned> &prior, set<unsigned> &sensor, set<unsigned> &internals,
+		unordered_map<unsigned,const Variable*> &transition,
+		EvidenceSource next, EstimateSink<Factor> estimate,
+		FilteringRun *run) {
+
+		// statistics of this run, discarded when the caller passes none
+		FilteringRun discarded;
+		FilteringRun &session = run ? *run : discarded;
+
+		unsigned steps = 0;
+		EvidenceRow evidence { nullptr, 0 };
+
+		// 1.5-slice junction tree
+		ScopedPhase phase(Profiler::SENSOR_MODEL);
+		JunctionTree jt(variables, factors, sensor, internals, transition, elimination_heuristic);
+		phase.stop();
+		session.induced_width = max(session.induced_width, jt.induced_width());
+
+		// prior model
+		Factor prior_model(1.0);
+		for (auto id : prior) {
+			prior_model = prior_model * *(factors[id]);
+		}
+
+		// initialize forward message in interface layout
+		const Domain &interface = jt.interface();
+		Factor forward(new Domain(interface));
+		vector<unsigned> inst(interface.width(), 0);
+		for (unsigned i = 0; i < interface.size(); ++i) {
+			forward[i] = prior_model[prior_model.domain().position_consistent_instantiation(inst, interface)];
+			interface.next_instantiation(inst);
+		}
+		forward.partition(prior_model.partition());
+
+		Profiler::end_setup();
+		while (next(evidence)) {
+			// project and update belief state
+			forward = jt.step(forward, evidence);
+
+			// hand the new estimate over
+			phase.next(Profiler::OUTPUT);
+			estimate(forward);
+			steps++;
+
+			phase.stop();
+			Profiler::end_step();
+		}
+
+		return steps;
+	}
+
 
 	ADDFactor variable_elimination(
+		ADDContext &context,
 		vector<const Variable*> &variables,
 		vector<shared_ptr<ADDFactor>> &factors) {
 
 		// initialize result
-		ADDFactor result;
+		ADDFactor result(context);
 
-		// choose elimination ordering
+		// eliminate in the ordering chosen by the caller
 		forward_list<const Variable*> ordering(variables.begin(), variables.end());
-		// Graph g(factors);
-		// vector<const Variable*> new_ordering = g.ordering(variables);
-		// forward_list<const Variable*> ordering(new_ordering.begin(), new_ordering.end());
 
 		// initialize buckets
 		unordered_map<unsigned,set<shared_ptr<ADDFactor>>> buckets;
@@ -223,20 +494,33 @@ namespace dbn {
 			const Variable *var = ordering.front();
 			ordering.pop_front();
 
-			// eliminate var
-			ADDFactor prod;
-			for (auto pf : buckets[var->id()]) {
-				prod *= *pf;
-			}
-			shared_ptr<ADDFactor> new_factor = make_shared<ADDFactor>(prod.sum_out(var));
+			vector<shared_ptr<ADDFactor>> bucket(buckets[var->id()].begin(), buckets[var->id()].end());
+			buckets.erase(var->id());
 
-			// stop if finished
-			if (buckets.empty()) {
-				result *= *new_factor;
-				// cout << *result << endl;
-				break;
+			// later variables mentioned only by this bucket are summed out with var
+			vector<const Variable*> eliminated(1, var);
+			for (auto pv : ordering) {
+				bool local = false;
+				for (auto pf : bucket) {
+					local = local || pf->in_scope(pv);
+				}
+				for (auto const &it_bucket : buckets) {
+					for (auto pf : it_bucket.second) {
+						local = local && !pf->in_scope(pv);
+					}
+				}
+				if (local) {
+					eliminated.push_back(pv);
+				}
+			}
+			for (unsigned i = 1; i < eliminated.size(); ++i) {
+				ordering.remove(eliminated[i]);
+				buckets.erase(eliminated[i]->id());
 			}
 
+			// fused product and abstraction of all eliminated variables
+			shared_ptr<ADDFactor> new_factor = make_shared<ADDFactor>(ADDFactor::sum_product(context, bucket, eliminated));
+
 			// update bucket list with new factor
 			bool in_bucket = false;
 			for (auto pv : ordering) {
@@ -255,24 +539,14 @@ namespace dbn {
 	}
 
 	ADDFactor project(
-		vector<shared_ptr<ADDFactor>> &factors,
+		ADDContext &context,
+		vector<const Variable*> &ordering,
+		vector<shared_ptr<ADDFactor>> &sum_prod_factors,
 		const unordered_map<unsigned,const Variable*> &transition,
 		const ADDFactor &forward) {
 
-		static vector<const Variable*> ordering;
-		static vector<shared_ptr<ADDFactor>> sum_prod_factors;
-
-		if (ordering.size() == 0 && sum_prod_factors.size() == 0) {
-			for (auto it_transition : transition) {
-				unsigned id_prime = it_transition.first;
-				const Variable *variable = it_transition.second;
-				ordering.push_back(variable);
-				sum_prod_factors.push_back(factors[id_prime]);
-			}
-		}
-
 		sum_prod_factors.push_back(make_shared<ADDFactor>(forward));
-		ADDFactor projection = variable_elimination(ordering, sum_prod_factors);
+		ADDFactor projection = variable_elimination(context, ordering, sum_prod_factors);
 		projection = projection.change_variables(transition);
 		sum_prod_factors.pop_back();
 		return projection;
@@ -280,14 +554,12 @@ namespace dbn {
 
 	ADDFactor update(
 		const ADDFactor &projection,
-		const ADDFactor &sensor_model,
-		const unordered_map<unsigned,unsigned> &evidence) {
+		const ADDFactor &evidence_t) {
 
-		// add observation from time t
-		ADDFactor evidence_t = sensor_model.conditioning(evidence);
-
-		// update projection with observation
-		ADDFactor belief_state = evidence_t * projection;
+		// update projection with observation from time t
+		ScopedPhase phase(Profiler::UPDATE);
+		ADDFactor belief_state = evidence_t.product(projection);
+		phase.next(Profiler::NORMALIZATION);
 		return belief_state.normalize();
 	}
 
@@ -295,25 +567,46 @@ namespace dbn {
 	filtering(
 		vector<const Variable*> &variables, vector<shared_ptr<ADDFactor>> &factors,
 		set<unsigned> &prior, set<unsigned> &sensor, set<unsigned> &internals,
-		unordered_map<unsigned,const Variable*> &transition,
-		vector<unordered_map<unsigned,unsigned>> &observations)
+		unordered_map<unsigned,const Variable*> &transition, set<unsigned> &forward_interface,
+		const Evidence &observations,
+		FilteringRun *run)
 	{
+		vector<shared_ptr<ADDFactor>> estimates;
+		filtering(variables, factors, prior, sensor, internals, transition, forward_interface, replay(observations),
+			[&estimates](const ADDFactor &belief_state) { estimates.push_back(make_shared<ADDFactor>(belief_state)); }, run);
+		return estimates;
+	}
 
-		ADDFactor::set_mgr_reordering();
+	unsigned
+	filtering(
+		vector<const Variable*> &variables, vector<shared_ptr<ADDFactor>> &factors,
+		set<unsigned> &prior, set<unsigned> &sensor, set<unsigned> &internals,
+		unordered_map<unsigned,const Variable*> &transition, set<unsigned> &forward_interface,
+		EvidenceSource next, EstimateSink<ADDFactor> estimate,
+		FilteringRun *run)
+	{
+
+		// statistics of this run, discarded when the caller passes none
+		FilteringRun discarded;
+		FilteringRun &session = run ? *run : discarded;
+
+		// all diagrams of this run live in the context of its factors
+		ADDContext &context = factors[0]->context();
+		context.set_reordering();
 
 		// unsigned sz = variables.size();
 		// int *permutation = new int[sz];
 		// for (unsigned i = 0; i < sz; ++i) {
 		// 	permutation[i] = variables[i]->id();
 		// }
-		// ADDFactor::set_mgr_reordering(permutation);
+		// context.set_reordering(permutation);
 		// delete[] permutation;
 
-		// estimates
-		vector<shared_ptr<ADDFactor>> estimates;
+		unsigned steps = 0;
+		EvidenceRow evidence { nullptr, 0 };
 
 		// prior model
-		ADDFactor prior_model;
+		ADDFactor prior_model(context);
 		for (auto id : prior) {
 			prior_model *= *factors[id];
 		}
@@ -330,188 +623,330 @@ namespace dbn {
 		for (auto id : internals) {
 			internal_variables.push_back(variables[id]);
 		}
-		ADDFactor sensor_model = variable_elimination(internal_variables, sensor_factors);
+		ScopedPhase phase(Profiler::SENSOR_MODEL);
+		internal_variables = elimination_ordering(session, "sensor", internal_variables, scopes(sensor_factors));
+		ADDFactor sensor_model = variable_elimination(context, internal_variables, sensor_factors);
+		phase.stop();
+
+		// slice variables outside the forward interface
+		vector<const Variable*> dropped;
+		for (auto it_transition : transition) {
+			const Variable *curr = it_transition.second;
+			if (!forward_interface.count(curr->id())) {
+				dropped.push_back(curr);
+			}
+		}
+
+		// sensor model conditioned on evidence, memoized by observation
+		SensorCache<ADDFactor> likelihoods(sensor_model, sensor_cache_capacity);
+		if (sensor_cache_prewarm) {
+			phase.next(Profiler::SENSOR_MODEL);
+			likelihoods.prewarm(sensor);
+			phase.stop();
+		}
 
 		// initialize forward message
-		ADDFactor forward = prior_model;
+		ADDFactor forward = marginalize(move(prior_model), dropped);
+
+		// transition model and its elimination ordering
+		vector<const Variable*> ordering;
+		vector<shared_ptr<ADDFactor>> sum_prod_factors;
+		transition_model(session, factors, transition, forward, ordering, sum_prod_factors);
 
-		for (auto evidence : observations) {
+		long next_reordering = reordering_threshold;
+		session.approximation_error = 0.0;
+
+		Profiler::end_setup();
+		while (next(evidence)) {
 			// project belief state
-			ADDFactor projection = project(factors, transition, forward);
+			phase.next(Profiler::PROJECTION);
+			ADDFactor projection = project(context, ordering, sum_prod_factors, transition, forward);
 
 			// update belief state
 			// forward = update(projection, internals, sensor_model, evidence);
-			forward = update(projection, sensor_model, evidence);
+			phase.next(Profiler::CONDITIONING);
+			const ADDFactor &likelihood = likelihoods(evidence);
+			phase.stop();
+			ADDFactor belief_state = update(projection, likelihood);
+
+			// merge near-identical leaves and renormalize; the approximation error
+			// sums the largest change of a single entry (L-infinity) over steps
+			if (approximation_epsilon > 0.0) {
+				phase.next(Profiler::NORMALIZATION);
+				double error;
+				belief_state = belief_state.approximate(approximation_epsilon, error).normalize();
+				session.approximation_error += error;
+			}
+
+			// hand the new estimate over
+			phase.next(Profiler::OUTPUT);
+			estimate(belief_state);
+			steps++;
+
+			// carry the forward interface only
+			phase.next(Profiler::PROJECTION);
+			forward = marginalize(move(belief_state), dropped);
+			phase.stop();
 
-			// add new estimate to filtering list
-			estimates.push_back(make_shared<ADDFactor>(forward));
+			// reorder between steps when the diagrams grow too large
+			if (reordering_threshold > 0 && context.mgr().ReadNodeCount() > next_reordering) {
+				context.reorder();
+				next_reordering = max(next_reordering, 2 * context.mgr().ReadNodeCount());
+			}
+
+			context.record_step();
+			Profiler::end_step();
 		}
 
+		session.sensor_cache_hits = likelihoods.hits();
+		session.sensor_cache_misses = likelihoods.misses();
+
+		return steps;
+	}
+
+	vector<shared_ptr<EVDDFactor>>
+	filtering(
+		vector<const Variable*> &variables, vector<shared_ptr<EVDDFactor>> &factors,
+		set<unsigned> &prior, set<unsigned> &sensor, set<unsigned> &internals,
+		unordered_map<unsigned,const Variable*> &transition, set<unsigned> &forward_interface,
+		const Evidence &observations,
+		FilteringRun *run)
+	{
+		vector<shared_ptr<EVDDFactor>> estimates;
+		filtering(variables, factors, prior, sensor, internals, transition, forward_interface, replay(observations),
+			[&estimates](const EVDDFactor &belief_state) { estimates.push_back(make_shared<EVDDFactor>(belief_state)); }, run);
 		return estimates;
 	}
 
+	unsigned
+	filtering(
+		vector<const Variable*> &variables, vector<shared_ptr<EVDDFactor>> &factors,
+		set<unsigned> &prior, set<unsigned> &sensor, set<unsigned> &internals,
+		unordered_map<unsigned,const Variable*> &transition, set<unsigned> &forward_interface,
+		EvidenceSource next, EstimateSink<EVDDFactor> estimate,
+		FilteringRun *run)
+	{
+
+		// statistics of this run, discarded when the caller passes none
+		FilteringRun discarded;
+		FilteringRun &session = run ? *run : discarded;
+
+		unsigned steps = 0;
+		EvidenceRow evidence { nullptr, 0 };
+
+		// prior model
+		EVDDFactor prior_model(1.0);
+		for (auto id : prior) {
+			prior_model *= *factors[id];
+		}
+
+		// (generalized) sensor model
+		vector<shared_ptr<EVDDFactor>> sensor_factors;
+		for (auto id : sensor) {
+			sensor_factors.push_back(factors[id]);
+		}
+		for (auto id : internals) {
+			sensor_factors.push_back(factors[id]);
+		}
+		vector<const Variable*> internal_variables;
+		for (auto id : internals) {
+			internal_variables.push_back(variables[id]);
+		}
+		ScopedPhase phase(Profiler::SENSOR_MODEL);
+		internal_variables = elimination_ordering(session, "sensor", internal_variables, scopes(sensor_factors));
+		EVDDFactor sensor_model = variable_elimination(internal_variables, sensor_factors);
+		phase.stop();
+
+		// slice variables outside the forward interface
+		vector<const Variable*> dropped;
+		for (auto it_transition : transition) {
+			const Variable *curr = it_transition.second;
+			if (!forward_interface.count(curr->id())) {
+				dropped.push_back(curr);
+			}
+		}
+
+		// sensor model conditioned on evidence, memoized by observation
+		SensorCache<EVDDFactor> likelihoods(sensor_model, sensor_cache_capacity);
+		if (sensor_cache_prewarm) {
+			phase.next(Profiler::SENSOR_MODEL);
+			likelihoods.prewarm(sensor);
+			phase.stop();
+		}
+
+		// initialize forward message
+		EVDDFactor forward = marginalize(move(prior_model), dropped);
+
+		// transition model and its elimination ordering
+		vector<const Variable*> ordering;
+		vector<shared_ptr<EVDDFactor>> sum_prod_factors;
+		transition_model(session, factors, transition, forward, ordering, sum_prod_factors);
+
+		unsigned next_collection = 1 << 16;
+
+		Profiler::end_setup();
+		while (next(evidence)) {
+			// project belief state
+			phase.next(Profiler::PROJECTION);
+			EVDDFactor projection = project(ordering, sum_prod_factors, transition, forward);
+
+			// update belief state
+			phase.next(Profiler::CONDITIONING);
+			const EVDDFactor &likelihood = likelihoods(evidence);
+			phase.stop();
+			EVDDFactor belief_state = update(projection, likelihood);
+
+			// hand the new estimate over
+			phase.next(Profiler::OUTPUT);
+			estimate(belief_state);
+			steps++;
+
+			// carry the forward interface only
+			phase.next(Profiler::PROJECTION);
+			forward = marginalize(move(belief_state), dropped);
+			phase.stop();
+
+			// reclaim intermediate nodes between steps
+			if (EVDDFactor::live_nodes() > next_collection) {
+				EVDDFactor::collect();
+				next_collection = max(next_collection, 2 * EVDDFactor::live_nodes());
+			}
+
+			Profiler::end_step();
+		}
+
+		session.sensor_cache_hits = likelihoods.hits();
+		session.sensor_cache_misses = likelihoods.misses();
+
+		return steps;
+	}
+
 
 	vector<shared_ptr<Factor>>
 	unrolled_filtering(
 		vector<const Variable*> variables, vector<shared_ptr<Factor>> &factors,
 		set<unsigned> &prior, set<unsigned> &sensor, set<unsigned> &internals,
 		unordered_map<unsigned,const Variable*> &transition,
-		vector<unordered_map<unsigned,unsigned>> &observations,
-		bool verbose)
+		const Evidence &observations,
+		bool verbose,
+		FilteringRun *run)
 	{
 
-		vector<shared_ptr<Factor>> estimates;
+		// statistics of this run, discarded when the caller passes none
+		FilteringRun discarded;
+		FilteringRun &session = run ? *run : discarded;
 
-		const int N = variables.size();
+		vector<shared_ptr<Factor>> estimates;
 
-		unordered_map<unsigned,const Variable *> renaming;
-		for (auto it_transition : transition) {
-			const Variable *next_var = variables[it_transition.first];
-			unsigned curr_id = it_transition.second->id();
-			renaming[curr_id] = next_var;
-		}
+		const unsigned N = variables.size();
 
-		vector<const Variable*> ordering;
-		vector<shared_ptr<Factor>> unrolled_factors;
-		for (auto prior_id : prior) {
-			unrolled_factors.push_back(factors[prior_id]);
-		}
+		// template slice: interface, internal and sensor variables of slice t
+		vector<unsigned> slice_ids;
 		for (auto it_transition : transition) {
-			unsigned id_next = it_transition.first;
-			unrolled_factors.push_back(factors[id_next]);
-
-			unsigned id_curr = it_transition.second->id();
-			ordering.push_back(variables[id_curr]);
+			slice_ids.push_back(it_transition.first);
 		}
 		for (auto internal_id : internals) {
-			Factor internal_factor(*factors[internal_id]);
-			internal_factor = internal_factor.change_variables(renaming);
-			Factor new_factor = internal_factor.conditioning(observations[0]).normalize();
-			unrolled_factors.push_back(make_shared<Factor>(new_factor));
-
-			ordering.push_back(variables[internal_id]);
+			slice_ids.push_back(internal_id);
 		}
 		for (auto sensor_id : sensor) {
-			Factor sensor_factor(*factors[sensor_id]);
-			sensor_factor = sensor_factor.change_variables(renaming);
-			Factor new_factor = sensor_factor.conditioning(observations[0]).normalize();
-			unrolled_factors.push_back(make_shared<Factor>(new_factor));
+			slice_ids.push_back(sensor_id);
 		}
+		const unsigned slice_width = slice_ids.size();
 
-		if (verbose) {
-			cout << "@ t = 1" << endl;
-			cout << "Renaming" << endl;
-			for (auto it : renaming) {
-				cout << it.first << ":" << it.second->id() << endl;
-			}
-			cout << "Unrolled factors:" << endl;
-			for (auto const& f : unrolled_factors) {
-				cout << f->domain() << endl;
-			}
-			cout << "Ordering" << endl;
-			for (auto pv : ordering) {
-				cout << pv->id() << " ";
+		// arena of variables for two consecutive slices, recycled alternately
+		vector<unique_ptr<Variable>> arena;
+		for (unsigned bank = 0; bank < 2; ++bank) {
+			for (unsigned k = 0; k < slice_width; ++k) {
+				arena.emplace_back(new Variable(N + bank * slice_width + k, variables[slice_ids[k]]->size()));
 			}
-			cout << endl << endl;
 		}
 
-		Factor estimate = variable_elimination(ordering, unrolled_factors).normalize();
-
-		unordered_map<unsigned,const Variable *> renaming_back;
-		const Domain &estimate_domain = estimate.domain();
-		const unsigned estimate_width = estimate_domain.width();
-		for (unsigned i = 0; i < estimate_width; ++i) {
-			unsigned var_id = estimate_domain[i]->id();
-			for (auto it_renaming : renaming) {
-				unsigned id_from = it_renaming.first;
-				unsigned id_to = it_renaming.second->id();
-				if (id_to == var_id) {
-					renaming_back[var_id] = variables[id_from];
+		// plan elimination of one slice, reused for all slices
+		unordered_map<unsigned,const Variable*> slice_renaming;
+		for (auto it_transition : transition) {
+			slice_renaming[it_transition.second->id()] = variables[it_transition.first];
+		}
+		vector<const Variable*> slice_variables;
+		vector<vector<const Variable*>> slice_scopes(1);
+		for (auto it_transition : transition) {
+			slice_variables.push_back(it_transition.second);
+			slice_scopes[0].push_back(it_transition.second);
+			slice_scopes.push_back(factors[it_transition.first]->domain().scope());
+		}
+		for (auto internal_id : internals) {
+			slice_variables.push_back(variables[internal_id]);
+		}
+		vector<unsigned> local_factors(internals.begin(), internals.end());
+		local_factors.insert(local_factors.end(), sensor.begin(), sensor.end());
+		for (auto id : local_factors) {
+			vector<const Variable*> scope;
+			for (auto pv : factors[id]->change_variables(slice_renaming).domain().scope()) {
+				if (!sensor.count(pv->id())) {
+					scope.push_back(pv);
 				}
 			}
+			slice_scopes.push_back(scope);
 		}
+		vector<const Variable*> slice_ordering = elimination_ordering(session, "unrolled", slice_variables, slice_scopes);
 
-		if (verbose) {
-			cout << "Renaming" << endl;
-			for (auto it : renaming) {
-				cout << it.first << ":" << it.second->id() << endl;
-			}
-			cout << "Renaming back" << endl;
-			for (auto it : renaming_back) {
-				cout << it.first << ":" << it.second->id() << endl;
-			}
+		// messages over the interface of the last slice eliminated so far
+		vector<shared_ptr<Factor>> messages;
+		for (auto prior_id : prior) {
+			messages.push_back(factors[prior_id]);
+		}
+		unordered_map<unsigned,const Variable*> interface;
+		for (auto it_transition : transition) {
+			const Variable *curr_var = it_transition.second;
+			interface[curr_var->id()] = curr_var;
 		}
 
-		estimate = estimate.change_variables(renaming_back);
-		estimates.push_back(make_shared<Factor>(estimate));
-
-		unsigned id = factors.size();
-		const unsigned T = observations.size();
-		for (unsigned t = 1; t < T; ++t) {
-
-			if (verbose) {
-				cout << "@ t = " << t+1 << endl;
-				cout << "Renaming" << endl;
-				for (auto it : renaming) {
-					cout << it.first << ":" << it.second->id() << endl;
-				}
+		const unsigned T = observations.timesteps();
+		Profiler::end_setup();
+		for (unsigned t = 0; t < T; ++t) {
+			const unordered_map<unsigned,unsigned> evidence = observations.observed(t);
+			const unsigned base = (t % 2) * slice_width;
+
+			// slice t+1 variables (template id -> arena variable)
+			unordered_map<unsigned,const Variable*> transition_renaming(interface);
+			unordered_map<unsigned,const Variable*> local_renaming;
+			unordered_map<unsigned,const Variable*> renaming_back;
+			for (unsigned k = 0; k < slice_width; ++k) {
+				local_renaming[slice_ids[k]] = arena[base + k].get();
 			}
-
 			for (auto it_transition : transition) {
-				unsigned id_next = it_transition.first;
-				unsigned id_curr = it_transition.second->id();
-
-				const Variable *new_var = new Variable(id, variables[id_next]->size());
-				renaming[id_next] = new_var;
-				variables.push_back(new_var);
-				id++;
-
-				Factor *new_factor = new Factor(*factors[id_next]);
-				*new_factor = new_factor->change_variables(renaming);
-
-				unrolled_factors.emplace_back(new_factor);
-				ordering.push_back(renaming[id_curr]);
+				const Variable *next_var = local_renaming[it_transition.first];
+				transition_renaming[it_transition.first] = next_var;
+				local_renaming[it_transition.second->id()] = next_var;
+				renaming_back[next_var->id()] = it_transition.second;
 			}
 
+			vector<shared_ptr<Factor>> slice_factors(messages);
 			for (auto it_transition : transition) {
-				unsigned id_next = it_transition.first;
-				unsigned id_curr = it_transition.second->id();
-				renaming[id_curr] = renaming[id_next];
-			}
-
-
-			for (auto internal_id : internals) {
-				const Variable *new_var = new Variable(id, variables[internal_id]->size());
-				renaming[internal_id] = new_var;
-				variables.push_back(new_var);
-				id++;
-
-				ordering.push_back(new_var);
+				slice_factors.push_back(make_shared<Factor>(factors[it_transition.first]->change_variables(transition_renaming)));
 			}
-			for (auto sensor_id : sensor) {
-				const Variable *new_var = new Variable(id, variables[sensor_id]->size());
-				renaming[sensor_id] = new_var;
-				variables.push_back(new_var);
-				id++;
+			ScopedPhase phase(Profiler::CONDITIONING);
+			for (auto id : local_factors) {
+				Factor new_factor = factors[id]->conditioning(evidence).normalize();
+				slice_factors.push_back(make_shared<Factor>(new_factor.change_variables(local_renaming)));
 			}
+			phase.stop();
 
-
-			for (auto internal_id : internals) {
-				Factor *internal_factor = factors[internal_id].get();
-				Factor new_factor = internal_factor->conditioning(observations[t]).normalize();
-				new_factor = new_factor.change_variables(renaming);
-				unrolled_factors.push_back(make_shared<Factor>(new_factor));
+			// eliminate interface of slice t and internals of slice t+1 only
+			vector<const Variable*> ordering;
+			for (auto pv : slice_ordering) {
+				unsigned template_id = pv->id();
+				ordering.push_back(interface.count(template_id) ? interface[template_id] : local_renaming[template_id]);
 			}
 			for (auto sensor_id : sensor) {
-				Factor *sensor_factor = factors[sensor_id].get();
-				Factor new_factor = sensor_factor->conditioning(observations[t]).normalize();
-				new_factor = new_factor.change_variables(renaming);
-				unrolled_factors.push_back(make_shared<Factor>(new_factor));
+				if (!evidence.count(sensor_id)) {
+					ordering.push_back(local_renaming[sensor_id]);
+				}
 			}
 
 			if (verbose) {
+				cout << "@ t = " << t+1 << endl;
 				cout << "Unrolled factors:" << endl;
-				for (auto const& f : unrolled_factors) {
+				for (auto const& f : slice_factors) {
 					cout << f->domain() << endl;
 				}
 				cout << "Ordering" << endl;
@@ -521,39 +956,25 @@ namespace dbn {
 				cout << endl << endl;
 			}
 
-			Factor estimate = variable_elimination(ordering, unrolled_factors).normalize();
-			unordered_map<unsigned,const Variable *> renaming_back;
-			const Domain &estimate_domain = estimate.domain();
-			const unsigned estimate_width = estimate_domain.width();
-			for (unsigned i = 0; i < estimate_width; ++i) {
-				unsigned var_id = estimate_domain[i]->id();
-				for (auto it_renaming : renaming) {
-					unsigned id_from = it_renaming.first;
-					unsigned id_to = it_renaming.second->id();
-					if (id_to == var_id) {
-						renaming_back[var_id] = variables[id_from];
-					}
-				}
+			// cache messages (rescaled to avoid underflow on long horizons)
+			phase.next(Profiler::UPDATE);
+			messages.clear();
+			Factor estimate(1.0);
+			for (auto pf : bucket_elimination(ordering, slice_factors)) {
+				if (pf->width() == 0) continue;
+				estimate *= *pf;
+				messages.push_back(make_shared<Factor>(pf->normalize()));
 			}
-
-			if (verbose) {
-				cout << "Renaming" << endl;
-				for (auto it : renaming) {
-					cout << it.first << ":" << it.second->id() << endl;
-				}
-				cout << "Renaming back" << endl;
-				for (auto it : renaming_back) {
-					cout << it.first << ":" << it.second->id() << endl;
-				}
+			for (auto it_transition : transition) {
+				interface[it_transition.second->id()] = transition_renaming[it_transition.first];
 			}
 
-			estimate = estimate.change_variables(renaming_back);
+			phase.next(Profiler::NORMALIZATION);
+			estimate = estimate.normalize().change_variables(renaming_back);
 			estimates.push_back(make_shared<Factor>(estimate));
-		}
 
-		unsigned variables_sz = variables.size();
-		for (unsigned i = N; i < variables_sz; ++i) {
-			delete variables[i];
+			phase.stop();
+			Profiler::end_step();
 		}
 
 		return estimates;
@@ -18,71 +18,177 @@
 
 #include "io.h"
 #include "domain.h"
+#include "mappedfile.h"
 
 #include <iostream>
-#include <fstream>
 #include <string>
 #include <vector>
 #include <set>
 #include <unordered_map>
 #include <memory>
+#include <algorithm>
+#include <thread>
+#include <cstdlib>
+#include <cstdint>
+#include <cctype>
 
 using namespace std;
 
 namespace dbn {
 
-    bool read_next_token(ifstream &input_file, string &token) {
-        while (input_file) {
-            input_file >> token;
-            if (token[0] != '#') return true;
-            getline(input_file, token);  // ignore rest of line
+    // below this many CPT entries the factors are filled sequentially
+    static const double PARALLEL_VALUES = 1 << 18;
+
+    // Whitespace separated tokens scanned in place. A token starting with
+    // '#' comments out the rest of the line; numbers consume their whole
+    // token, as the stream extraction did.
+    class Scanner {
+    public:
+        Scanner(const char *begin, const char *end) : _current(begin), _end(end) { }
+
+        const char *position() const { return _current; }
+
+        bool next_token(string &token) {
+            if (!skip_blanks()) return false;
+            const char *first = _current;
+            skip_token();
+            token.assign(first, _current);
+            return true;
         }
-        return false;
-    }
 
-    bool read_next_integer(ifstream &input_file, unsigned &i) {
-        string token;
-        if (!read_next_token(input_file, token)) return false;
-        i = stoi(token);
-        return true;
-    }
+        bool next_integer(unsigned &i) {
+            i = 0;
+            if (!skip_blanks()) return false;
+            const char *p = _current;
+            if (*p == '+') ++p;
+            while (p < _end && *p >= '0' && *p <= '9') {
+                i = 10 * i + (*p++ - '0');
+            }
+            skip_token();
+            return true;
+        }
 
-    bool read_next_double(ifstream &input_file, double &d) {
-        string token;
-        if (!read_next_token(input_file, token)) return false;
-        d = stod(token);
-        return true;
-    }
+        bool next_double(double &d) {
+            d = 0.0;
+            if (!skip_blanks()) return false;
+            const char *first = _current;
+            skip_token();
+            const char *last = _current;
+
+            // decimal significand and exponent
+            const char *p = first;
+            bool negative = (*p == '-');
+            if (*p == '-' || *p == '+') ++p;
+            uint64_t mantissa = 0;
+            int digits = 0, exponent = 0;
+            bool valid = false;
+            for (; p < last && *p >= '0' && *p <= '9'; ++p, valid = true) {
+                if (digits < 19) {
+                    mantissa = 10 * mantissa + (*p - '0');
+                    if (mantissa) digits++;
+                }
+                else exponent++;
+            }
+            if (p < last && *p == '.') {
+                for (++p; p < last && *p >= '0' && *p <= '9'; ++p, valid = true) {
+                    if (digits < 19) {
+                        mantissa = 10 * mantissa + (*p - '0');
+                        if (mantissa) digits++;
+                        exponent--;
+                    }
+                }
+            }
+            if (valid && p < last && (*p == 'e' || *p == 'E')) {
+                const char *q = p + 1;
+                bool negative_exponent = (q < last && *q == '-');
+                if (q < last && (*q == '-' || *q == '+')) ++q;
+                int e = 0;
+                bool exponent_digits = false;
+                for (; q < last && *q >= '0' && *q <= '9'; ++q, exponent_digits = true) {
+                    if (e < 10000) e = 10 * e + (*q - '0');
+                }
+                if (exponent_digits) {
+                    exponent += (negative_exponent ? -e : e);
+                    p = q;
+                }
+            }
+
+            // exact when significand and power of ten are both exact doubles
+            static const double powers[] = {
+                1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+            };
+            if (valid && p == last && digits <= 15 && exponent >= -22 && exponent <= 22) {
+                d = static_cast<double>(mantissa);
+                d = (exponent < 0 ? d / powers[-exponent] : d * powers[exponent]);
+                if (negative) d = -d;
+                return true;
+            }
+
+            // anything else goes through the library conversion
+            char token[128];
+            size_t length = min<size_t>(last - first, sizeof(token) - 1);
+            copy(first, first + length, token);
+            token[length] = '\0';
+            d = strtod(token, nullptr);
+            return true;
+        }
+
+        bool skip_token() {
+            if (!skip_blanks()) return false;
+            while (_current < _end && !isspace(static_cast<unsigned char>(*_current))) ++_current;
+            return true;
+        }
+
+    private:
+        bool skip_blanks() {
+            while (_current < _end) {
+                if (*_current == '#') {
+                    while (_current < _end && *_current != '\n') ++_current;
+                }
+                else if (isspace(static_cast<unsigned char>(*_current))) {
+                    ++_current;
+                }
+                else {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        const char *_current;
+        const char *_end;
+    };
 
-    string read_file_header(ifstream &input_file) {
+    string read_file_header(Scanner &input) {
         string token;
-        read_next_token(input_file, token);
+        input.next_token(token);
         if (token.compare("DBAYES") != 0)  {
             cerr << "ERROR! Expected 'DBAYES' file header, found: " << token << endl;
         }
         return token;
     }
 
-    void read_variables(ifstream &input_file, unsigned &order, vector<unique_ptr<Variable>> &variables) {
-        read_next_integer(input_file, order);
+    void read_variables(Scanner &input, unsigned &order, vector<unique_ptr<Variable>> &variables) {
+        input.next_integer(order);
 
         unsigned sz = 0;
         for (unsigned id = 0; id < order; ++id) {
-            read_next_integer(input_file, sz);
+            input.next_integer(sz);
             variables.emplace_back(new Variable(id, sz));
         }
     }
 
     void read_interface_model(
-        ifstream &input_file,
+        Scanner &input,
         unsigned &interface_order, set<unsigned> &interface, set<unsigned> &prior,
         unordered_map<unsigned,const Variable*> &transition, const vector<unique_ptr<Variable>> &variables) {
 
-        read_next_integer(input_file, interface_order);
+        input.next_integer(interface_order);
         unsigned curr, next;
         for (unsigned i = 0; i < interface_order/2; ++i) {
-            read_next_integer(input_file, curr);
-            read_next_integer(input_file, next);
+            input.next_integer(curr);
+            input.next_integer(next);
             prior.insert(curr);
             interface.insert(curr);
             interface.insert(next);
@@ -91,13 +197,13 @@ namespace dbn {
     }
 
     void read_sensor_model(
-        ifstream &input_file,
+        Scanner &input,
         unsigned &sensor_order, set<unsigned> &sensor) {
 
-        read_next_integer(input_file, sensor_order);
+        input.next_integer(sensor_order);
         unsigned v;
         for (unsigned i = 0; i < sensor_order; ++i) {
-            read_next_integer(input_file, v);
+            input.next_integer(v);
             sensor.insert(v);
         }
     }
@@ -115,72 +221,178 @@ namespace dbn {
         internals_order = internals.size();
     }
 
-    void read_factors(ifstream &input_file, unsigned order, vector<unique_ptr<Variable>> &variables, vector<shared_ptr<Factor>> &factors) {
+    void read_forward_interface(
+        vector<shared_ptr<Factor>> &factors,
+        unordered_map<unsigned,const Variable*> &transition,
+        set<unsigned> &forward_interface) {
+
+        // slice t variables with children in slice t+1 (Murphy, 2002)
+        for (auto it_transition : transition) {
+            const Domain &domain = factors[it_transition.first]->domain();
+            for (auto it_parent : transition) {
+                const Variable *curr = it_parent.second;
+                if (domain.in_scope(curr)) {
+                    forward_interface.insert(curr->id());
+                }
+            }
+        }
+    }
+
+    void read_factors(Scanner &input, unsigned order, vector<unique_ptr<Variable>> &variables, vector<shared_ptr<Factor>> &factors) {
         unsigned width, id;
         for (unsigned i = 0; i < order; ++i) {
-            read_next_integer(input_file, width);
+            input.next_integer(width);
 
             vector<const Variable*> scope;
             for (unsigned j = 0; j < width; ++j) {
-                read_next_integer(input_file, id);
+                input.next_integer(id);
                 scope.push_back(variables[id].get());
             }
 
             factors.emplace_back(new Factor(new Domain(scope)));
         }
 
+        // locate the value block of each factor
+        vector<const char*> blocks(order);
+        vector<unsigned> sizes(order);
+        double total = 0.0;
         for (unsigned i = 0; i < order; ++i) {
-            unsigned factor_size;
-            read_next_integer(input_file, factor_size);
+            input.next_integer(sizes[i]);
+            blocks[i] = input.position();
+            for (unsigned j = 0; j < sizes[i]; ++j) {
+                input.skip_token();
+            }
+            total += sizes[i];
+        }
+
+        auto fill = [&](unsigned first, unsigned last) {
+            for (unsigned i = first; i < last; ++i) {
+                Scanner block(blocks[i], input.position());
+                double partition = 0;
+                for (unsigned j = 0; j < sizes[i]; ++j) {
+                    double value;
+                    block.next_double(value);
+                    (*(factors[i]))[j] = value;
+                    partition += value;
+                }
+                factors[i]->partition(partition);
+            }
+        };
 
-            double partition = 0;
-            for (unsigned j = 0; j < factor_size; ++j) {
-                double value;
-                read_next_double(input_file, value);
-                (*(factors[i]))[j] = value;
-                partition += value;
+        // parse blocks concurrently, in ranges of about the same number of values
+        unsigned nthreads = min<unsigned>(thread::hardware_concurrency(), order);
+        if (total < PARALLEL_VALUES || nthreads < 2) {
+            fill(0, order);
+            return;
+        }
+        vector<thread> workers;
+        unsigned first = 0;
+        double filled = 0.0;
+        for (unsigned t = 1; t <= nthreads && first < order; ++t) {
+            unsigned last = first;
+            while (last < order && (t == nthreads || filled < total * t / nthreads)) {
+                filled += sizes[last++];
             }
-            factors[i]->partition(partition);
+            workers.emplace_back(fill, first, last);
+            first = last;
+        }
+        for (auto &worker : workers) {
+            worker.join();
         }
     }
 
-    void read_addfactors(vector<shared_ptr<Factor>> &factors, vector<shared_ptr<ADDFactor>> &addfactors) {
+    vector<vector<const Variable*>> variable_groups(const vector<shared_ptr<Factor>> &factors, const unordered_map<unsigned,const Variable*> &transition) {
+        vector<vector<const Variable*>> groups;
+
+        // interface pairs (current, next) in order of current variable
+        vector<pair<const Variable*,const Variable*>> pairs;
+        set<unsigned> state;
+        for (auto it_transition : transition) {
+            const Variable *next = factors[it_transition.first]->domain()[(unsigned)0];
+            pairs.emplace_back(it_transition.second, next);
+            state.insert(it_transition.second->id());
+            state.insert(next->id());
+        }
+        sort(pairs.begin(), pairs.end(),
+            [](const pair<const Variable*,const Variable*> &p1, const pair<const Variable*,const Variable*> &p2) { return p1.first->id() < p2.first->id(); });
+
+        // each sensor or internal variable goes right after its last parent
+        set<unsigned> placed;
+        for (auto const &p : pairs) {
+            groups.push_back({ p.first, p.second });
+            placed.insert(p.first->id());
+            placed.insert(p.second->id());
+
+            bool changed = true;
+            while (changed) {
+                changed = false;
+                for (auto const &f : factors) {
+                    const Domain &domain = f->domain();
+                    const Variable *child = domain[(unsigned)0];
+                    if (state.count(child->id()) || placed.count(child->id())) continue;
+                    bool ready = true;
+                    for (unsigned i = 1; i < domain.width(); ++i) {
+                        ready = ready && placed.count(domain[i]->id());
+                    }
+                    if (ready) {
+                        groups.push_back({ child });
+                        placed.insert(child->id());
+                        changed = true;
+                    }
+                }
+            }
+        }
+        return groups;
+    }
+
+    void read_addfactors(ADDContext &context, const vector<shared_ptr<Factor>> &factors, const unordered_map<unsigned,const Variable*> &transition, vector<shared_ptr<ADDFactor>> &addfactors) {
+        for (auto const &group : variable_groups(factors, transition)) {
+            context.group(group);
+        }
         for (auto &f : factors) {
             const Domain &domain = f->domain();
             unsigned id = domain[(unsigned)0]->id();
             string output = to_string(id);
-            ADDFactor *addf = new ADDFactor(output, *f);
+            ADDFactor *addf = new ADDFactor(context, output, *f);
             addfactors.emplace_back(addf);
         }
     }
 
+    void read_evddfactors(const vector<shared_ptr<Factor>> &factors, const unordered_map<unsigned,const Variable*> &transition, vector<shared_ptr<EVDDFactor>> &evddfactors) {
+        for (auto const &group : variable_groups(factors, transition)) {
+            EVDDFactor::group(group);
+        }
+        for (auto &f : factors) {
+            evddfactors.push_back(make_shared<EVDDFactor>(*f));
+        }
+    }
+
     int read_uai_model(
         const char *filename,
         unsigned &order,
         vector<unique_ptr<Variable>> &variables,
         vector<shared_ptr<Factor>> &factors,
-        vector<shared_ptr<ADDFactor>> &addfactors,
         set<unsigned> &prior, set<unsigned> &interface, set<unsigned> &sensor, set<unsigned> &internals,
-        unordered_map<unsigned,const Variable*> &transition) {
+        unordered_map<unsigned,const Variable*> &transition, set<unsigned> &forward_interface) {
 
-        ifstream input_file(filename);
-        if (input_file.is_open()) {
-            read_file_header(input_file);
-            read_variables(input_file, order, variables);
+        MappedFile file(filename);
+        if (file.is_open()) {
+            Scanner input(file.begin(), file.end());
+            read_file_header(input);
+            read_variables(input, order, variables);
 
             unsigned interface_order;
-            read_interface_model(input_file, interface_order, interface, prior, transition, variables);
+            read_interface_model(input, interface_order, interface, prior, transition, variables);
 
             unsigned sensor_order;
-            read_sensor_model(input_file, sensor_order, sensor);
+            read_sensor_model(input, sensor_order, sensor);
 
             unsigned internals_order;
             read_internals_model(variables, internals_order, interface, sensor, internals);
 
-            read_factors(input_file, order, variables, factors);
-            read_addfactors(factors, addfactors);
+            read_factors(input, order, variables, factors);
 
-            input_file.close();
+            read_forward_interface(factors, transition, forward_interface);
             return 0;
         }
         else {
@@ -192,39 +404,63 @@ namespace dbn {
 
     int read_observations(
         const char *filename,
-        vector<unordered_map<unsigned,unsigned>> &observations,
+        const vector<unique_ptr<Variable>> &variables,
+        Evidence &observations,
         set<unsigned> &state_variables) {
 
-        ifstream input_file(filename);
-        if (input_file.is_open()) {
+        MappedFile file(filename);
+        if (file.is_open()) {
+            Scanner input(file.begin(), file.end());
             unsigned length, width;
 
-            read_next_integer(input_file, width);
-            read_next_integer(input_file, length);
+            input.next_integer(width);
+            input.next_integer(length);
 
-            for (unsigned t = 0; t < length; ++t) {
-                observations.emplace_back();
+            // variable lines are located first to lay out the table
+            vector<unsigned> ids(width);
+            vector<const char*> lines(width);
+            for (unsigned i = 0; i < width; ++i) {
+                input.next_integer(ids[i]);
+                lines[i] = input.position();
+                for (unsigned t = 0; t < length; ++t) {
+                    input.skip_token();
+                }
             }
+            vector<unsigned> columns;
+            for (unsigned id : ids) {
+                if (id >= variables.size()) {
+                    cerr << "Error: evidence variable " << id << " is not in the model" << endl;
+                    return -1;
+                }
+                if (find(columns.begin(), columns.end(), id) == columns.end()) {
+                    columns.push_back(id);
+                }
+            }
+            observations = Evidence(columns, length);
 
             for (unsigned i = 0; i < width; ++i) {
-                unsigned id;
-                read_next_integer(input_file, id);
+                Scanner line(lines[i], input.position());
+                unsigned column = observations.column(ids[i]);
+                unsigned cardinality = variables[ids[i]]->size();
                 for (unsigned t = 0; t < length; ++t) {
                     unsigned evidence;
-                    read_next_integer(input_file, evidence);
-                    observations[t][id] = evidence;
+                    line.next_integer(evidence);
+                    if (evidence >= Evidence::MISSING || evidence >= cardinality) {
+                        cerr << "Error: evidence value " << evidence << " of variable " << ids[i] << " out of range";
+                        cerr << " (cardinality " << cardinality << ") at timestep " << t + 1 << endl;
+                        return -1;
+                    }
+                    observations.set(t, column, evidence);
                 }
             }
 
             unsigned state_width;
-            read_next_integer(input_file, state_width);
+            input.next_integer(state_width);
             for (unsigned i = 0; i < state_width; ++i) {
                 unsigned id;
-                read_next_integer(input_file, id);
+                input.next_integer(id);
                 state_variables.insert(id);
             }
-
-            input_file.close();
             return 0;
         }
         else {
@@ -0,0 +1,358 @@
+// Copyright (c) 2015 Thiago Pereira Bueno
+// All Rights Reserved.
+//
+// This file is part of DBN library.
+//
+// DBN is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// DBN is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DBN.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "junctiontree.h"
+#include "profiler.h"
+#include "memoryaccountant.h"
+
+#include <algorithm>
+#include <queue>
+#include <tuple>
+
+using namespace std;
+
+namespace dbn {
+
+	JunctionTree::JunctionTree(
+		const vector<const Variable*> &variables, vector<shared_ptr<Factor>> &factors,
+		const set<unsigned> &sensor, const set<unsigned> &internals,
+		const unordered_map<unsigned,const Variable*> &transition,
+		Graph::Heuristic heuristic) :
+		_bytes(0)
+	{
+		// interface of slice t-1 and its copy in slice t (same order)
+		vector<const Variable*> curr, next;
+		unordered_map<unsigned,const Variable*> renaming;
+		for (auto it_transition : transition) {
+			const Variable *next_var = variables[it_transition.first];
+			const Variable *curr_var = it_transition.second;
+			curr.push_back(curr_var);
+			next.push_back(next_var);
+			renaming[curr_var->id()] = next_var;
+		}
+		_interface = Domain(curr);
+		_next_interface = Domain(next);
+
+		// 1.5-slice network: 2TBN plus slice t sensor and internal models
+		vector<shared_ptr<Factor>> network;
+		for (auto it_transition : transition) {
+			network.push_back(factors[it_transition.first]);
+		}
+		for (auto id : internals) {
+			network.push_back(make_shared<Factor>(factors[id]->change_variables(renaming)));
+		}
+		for (auto id : sensor) {
+			network.push_back(make_shared<Factor>(factors[id]->change_variables(renaming)));
+		}
+
+		vector<const Variable*> network_variables(curr);
+		network_variables.insert(network_variables.end(), next.begin(), next.end());
+		for (auto id : internals) {
+			network_variables.push_back(variables[id]);
+		}
+		for (auto id : sensor) {
+			network_variables.push_back(variables[id]);
+		}
+
+		// triangulate moral graph constraining both interfaces to be complete
+		Graph g(network);
+		g.add_clique(curr);
+		g.add_clique(next);
+		vector<vector<const Variable*>> candidates = g.cliques(g.ordering(network_variables, heuristic));
+		_induced_width = g.induced_width();
+
+		// keep maximal cliques only
+		sort(candidates.begin(), candidates.end(),
+			[](const vector<const Variable*> &c1, const vector<const Variable*> &c2) { return c1.size() > c2.size(); });
+		vector<set<unsigned>> maximal;
+		for (auto const &candidate : candidates) {
+			set<unsigned> ids;
+			for (auto pv : candidate) {
+				ids.insert(pv->id());
+			}
+			bool subsumed = false;
+			for (auto const &clique : maximal) {
+				if (includes(clique.begin(), clique.end(), ids.begin(), ids.end())) {
+					subsumed = true;
+					break;
+				}
+			}
+			if (!subsumed) {
+				maximal.push_back(ids);
+			}
+		}
+
+		unsigned ncliques = maximal.size();
+		_cliques.reserve(ncliques);
+		for (auto const &ids : maximal) {
+			vector<const Variable*> scope;
+			for (auto id : ids) {
+				scope.push_back(variables[id]);
+			}
+			double entries = 1.0;
+			for (auto pv : scope) {
+				entries *= pv->size();
+			}
+			MemoryAccountant::check(entries * sizeof(double), "junction tree clique");
+			_cliques.emplace_back();
+			Clique &clique = _cliques.back();
+			clique.domain = Domain(scope);
+			resize(clique.potential, clique.domain.size(), 1.0);
+			clique.parent = -1;
+		}
+
+		// maximum spanning tree on separator sizes (Kruskal)
+		vector<tuple<unsigned,unsigned,unsigned>> edges;
+		for (unsigned i = 0; i < ncliques; ++i) {
+			for (unsigned j = i+1; j < ncliques; ++j) {
+				vector<unsigned> separator;
+				set_intersection(
+					maximal[i].begin(), maximal[i].end(),
+					maximal[j].begin(), maximal[j].end(),
+					back_inserter(separator));
+				edges.emplace_back(separator.size(), i, j);
+			}
+		}
+		sort(edges.begin(), edges.end(),
+			[](const tuple<unsigned,unsigned,unsigned> &e1, const tuple<unsigned,unsigned,unsigned> &e2) { return get<0>(e1) > get<0>(e2); });
+
+		vector<unsigned> component(ncliques);
+		for (unsigned i = 0; i < ncliques; ++i) {
+			component[i] = i;
+		}
+		vector<vector<unsigned>> adj(ncliques);
+		for (auto const &e : edges) {
+			unsigned i = get<1>(e), j = get<2>(e);
+			unsigned ci = component[i], cj = component[j];
+			if (ci == cj) continue;
+			for (auto &c : component) {
+				if (c == cj) c = ci;
+			}
+			adj[i].push_back(j);
+			adj[j].push_back(i);
+		}
+
+		// root holds slice t interface, forward message enters at slice t-1 interface
+		_root = ncliques;
+		_in = ncliques;
+		for (unsigned i = 0; i < ncliques; ++i) {
+			const Domain &d = _cliques[i].domain;
+			bool has_curr = true, has_next = true;
+			for (auto pv : curr) has_curr = has_curr && d.in_scope(pv);
+			for (auto pv : next) has_next = has_next && d.in_scope(pv);
+			if (has_next && (_root == ncliques || d.size() < _cliques[_root].domain.size())) _root = i;
+			if (has_curr && (_in == ncliques || d.size() < _cliques[_in].domain.size())) _in = i;
+		}
+
+		// message schedule from leaves to root
+		vector<unsigned> order;
+		vector<bool> visited(ncliques, false);
+		queue<unsigned> frontier;
+		frontier.push(_root);
+		visited[_root] = true;
+		while (!frontier.empty()) {
+			unsigned k = frontier.front();
+			frontier.pop();
+			order.push_back(k);
+			for (auto j : adj[k]) {
+				if (visited[j]) continue;
+				visited[j] = true;
+				_cliques[j].parent = k;
+				frontier.push(j);
+			}
+		}
+		for (auto it = order.rbegin(); it != order.rend(); ++it) {
+			if (*it != _root) {
+				_schedule.push_back(*it);
+			}
+		}
+
+		// assign each factor to the smallest clique covering its scope
+		for (auto const &pf : network) {
+			const Domain &fd = pf->domain();
+			int best = -1;
+			for (unsigned i = 0; i < ncliques; ++i) {
+				const Domain &d = _cliques[i].domain;
+				bool covers = true;
+				for (auto pv : fd.scope()) covers = covers && d.in_scope(pv);
+				if (covers && (best < 0 || d.size() < _cliques[best].domain.size())) best = i;
+			}
+			Clique &clique = _cliques[best];
+			vector<unsigned> positions = index_map(clique.domain, fd);
+			unsigned size = clique.domain.size();
+			for (unsigned i = 0; i < size; ++i) {
+				clique.potential[i] *= (*pf)[positions[i]];
+			}
+		}
+
+		prepare(unordered_map<unsigned,unsigned>());
+	}
+
+	unsigned
+	JunctionTree::max_clique_size() const
+	{
+		unsigned max_size = 0;
+		for (auto const &clique : _cliques) {
+			max_size = max(max_size, clique.domain.size());
+		}
+		return max_size;
+	}
+
+	JunctionTree::~JunctionTree()
+	{
+		MemoryAccountant::release(_bytes);
+	}
+
+	// grows a clique buffer within the memory budget (capacity is kept
+	// when a later evidence layout is smaller)
+	void
+	JunctionTree::resize(vector<double> &buffer, unsigned size, double value)
+	{
+		size_t before = buffer.capacity() * sizeof(double);
+		if (size > buffer.capacity()) {
+			MemoryAccountant::check((size - buffer.capacity()) * sizeof(double), "junction tree clique");
+		}
+		buffer.resize(size, value);
+		size_t after = buffer.capacity() * sizeof(double);
+		MemoryAccountant::allocate(after - before);
+		_bytes += after - before;
+	}
+
+	void
+	JunctionTree::prepare(const unordered_map<unsigned,unsigned> &evidence)
+	{
+		for (auto &clique : _cliques) {
+			clique.reduced = Domain(clique.domain, evidence);
+			clique.gather = index_map(clique.reduced, clique.domain);
+			clique.strides.clear();
+			for (unsigned i = 0; i < clique.domain.width(); ++i) {
+				unsigned id = clique.domain[i]->id();
+				if (evidence.count(id)) {
+					clique.strides.emplace_back(id, clique.domain.offset(i));
+				}
+			}
+			resize(clique.table, clique.reduced.size());
+		}
+
+		for (auto k : _schedule) {
+			Clique &clique = _cliques[k];
+			Clique &parent = _cliques[clique.parent];
+			vector<const Variable*> scope;
+			for (auto pv : clique.reduced.scope()) {
+				if (parent.reduced.in_scope(pv)) {
+					scope.push_back(pv);
+				}
+			}
+			Domain separator(scope);
+			clique.projection = index_map(clique.reduced, separator);
+			clique.extension = index_map(parent.reduced, separator);
+			resize(clique.message, separator.size());
+		}
+
+		_forward_map = index_map(_cliques[_in].reduced, _interface);
+		_root_map = index_map(_cliques[_root].reduced, _next_interface);
+	}
+
+	Factor
+	JunctionTree::step(const Factor &forward, const EvidenceRow &evidence)
+	{
+		ScopedPhase phase(Profiler::CONDITIONING);
+		vector<unsigned> observed;
+		for (unsigned i = 0; i < evidence.width(); ++i) {
+			if (evidence.value(i) != Evidence::MISSING) {
+				observed.push_back(evidence.variable(i));
+			}
+		}
+		sort(observed.begin(), observed.end());
+		if (observed != _observed) {
+			prepare(evidence.observed());
+			_observed = observed;
+		}
+
+		// load clique potentials consistent with evidence
+		double entries = 0.0;
+		for (auto &clique : _cliques) {
+			unsigned base = 0;
+			for (auto const &s : clique.strides) {
+				base += s.second * evidence.value(evidence.column(s.first));
+			}
+			unsigned size = clique.table.size();
+			for (unsigned i = 0; i < size; ++i) {
+				clique.table[i] = clique.potential[base + clique.gather[i]];
+			}
+			entries += size;
+		}
+		if (Profiler::enabled()) Profiler::touch(entries);
+
+		// absorb forward message
+		phase.next(Profiler::UPDATE);
+		Clique &in = _cliques[_in];
+		unsigned in_size = in.table.size();
+		for (unsigned i = 0; i < in_size; ++i) {
+			in.table[i] *= forward[_forward_map[i]];
+		}
+
+		// collect messages to root
+		for (auto k : _schedule) {
+			Clique &clique = _cliques[k];
+			Clique &parent = _cliques[clique.parent];
+			fill(clique.message.begin(), clique.message.end(), 0.0);
+			unsigned size = clique.table.size();
+			for (unsigned i = 0; i < size; ++i) {
+				clique.message[clique.projection[i]] += clique.table[i];
+			}
+			unsigned parent_size = parent.table.size();
+			for (unsigned j = 0; j < parent_size; ++j) {
+				parent.table[j] *= clique.message[clique.extension[j]];
+			}
+		}
+
+		// marginalize root onto slice t interface
+		Factor belief(new Domain(_interface), 0.0);
+		Clique &root = _cliques[_root];
+		unsigned root_size = root.table.size();
+		double partition = 0.0;
+		for (unsigned i = 0; i < root_size; ++i) {
+			belief[_root_map[i]] += root.table[i];
+			partition += root.table[i];
+		}
+		belief.partition(partition);
+		if (Profiler::enabled()) Profiler::touch(2.0 * entries);
+
+		phase.next(Profiler::NORMALIZATION);
+		return belief.normalize();
+	}
+
+	ostream &
+	operator<<(ostream &os, const JunctionTree &jt)
+	{
+		os << "JunctionTree(cliques = " << jt.cliques() << ", ";
+		os << "max_clique_size = " << jt.max_clique_size() << ", ";
+		os << "interface_size = " << jt._interface.size() << ")" << endl;
+		unsigned ncliques = jt._cliques.size();
+		for (unsigned k = 0; k < ncliques; ++k) {
+			const JunctionTree::Clique &clique = jt._cliques[k];
+			os << k << " : " << clique.domain << " -> " << clique.parent;
+			if (k == jt._root) os << " (root)";
+			if (k == jt._in) os << " (in)";
+			os << endl;
+		}
+		return os;
+	}
+
+}
@@ -18,16 +18,25 @@
 
 #include "io.h"
 #include "inference.h"
+#include "densehmm.h"
+#include "modelimage.h"
+#include "evidencestream.h"
+#include "marginalsink.h"
+#include "profiler.h"
+#include "memoryaccountant.h"
 
 #include <cstring>
+#include <cstdlib>
 #include <iomanip>
 #include <iostream>
+#include <fstream>
 #include <vector>
 #include <unordered_map>
 #include <set>
 #include <memory>
 #include <chrono>
 #include <algorithm>
+#include <functional>
 
 #include "addfactor.h"
 
@@ -35,20 +44,59 @@ using namespace std;
 using namespace dbn;
 
 void usage(const char *filename);
-int read_options(int argc, char *argv[], bool &verbose, bool &m1, bool &m2, bool &m3);
+int compile(int argc, char *argv[]);
+int read_options(int argc, char *argv[], bool &verbose, bool &m1, bool &m2, bool &m3, bool &m4, bool &m5, Graph::Heuristic &heuristic, string &cache_dir, unsigned &sensor_cache, bool &prewarm, unsigned &dense_limit, long &reordering, double &epsilon, string &statistics_file, string &output_file, string &output_format, string &profile_file, size_t &mem_limit, string &mem_fallback);
 
 void print_model(
     vector<unique_ptr<Variable>> &variables, vector<shared_ptr<Factor>> &factors,
     vector<unsigned> &prior, unordered_map<unsigned,const Variable*> &transition, vector<unsigned> &sensor
 );
 
-void print_observations(vector<unordered_map<unsigned,unsigned>> &observations);
+void print_observations(const Evidence &observations);
+
+// method tag of the approximate ADD filtering run by --mem-fallback, in
+// the output and the profiles, apart from the exact methods 1-5
+const unsigned APPROXIMATE_FALLBACK = 6;
+
+void write_profiles(ostream &os, const Profile &load, const vector<pair<unsigned,Profile>> &profiles);
+
+bool within_budget(unsigned method, function<void()> filter);
 
 template<class T>
 void print_trajectory(vector<shared_ptr<T>> &states, set<unsigned> &state_variables, bool verbose = false);
 
+// Bookkeeping of a filtering run: each estimate is projected onto the state
+// variables and written to the output as soon as it is computed; the whole
+// belief state is kept only for the trajectory printout.
+template<class T>
+struct Estimates {
+    Estimates(unsigned method, MarginalSink *output, const Domain &domain, bool keep) :
+        method(method), output(output), domain(domain), keep(keep), steps(0),
+        avg_compactation(0.0), max_compactation(0.0), avg_nodes(0.0), max_nodes(0.0) { }
+
+    EstimateSink<T> sink() {
+        return [this](const T &belief_state) { add(belief_state); };
+    }
+
+    void add(const T &belief_state);
+
+    unsigned method;
+    MarginalSink *output;
+    const Domain &domain;
+    bool keep;
+
+    unsigned steps;
+    double avg_compactation, max_compactation;
+    double avg_nodes, max_nodes;
+    vector<shared_ptr<T>> states;
+};
+
 int main(int argc, char *argv[])
 {
+    if (argc >= 2 && string(argv[1]) == "compile") {
+        return compile(argc, argv);
+    }
+
     if (argc < 3) {
         usage(argv[0]);
         return -1;
@@ -58,32 +106,70 @@ int main(int argc, char *argv[])
     char *evidence = argv[2];
 
     bool verbose = false;
-    bool m1 = false, m2 = false, m3 = false;
-    if (read_options(argc, argv, verbose, m1, m2, m3)) return -1;
+    bool m1 = false, m2 = false, m3 = false, m4 = false, m5 = false;
+    Graph::Heuristic heuristic = Graph::MIN_FILL;
+    const char *home = getenv("HOME");
+    string cache_dir = (home ? string(home) + "/.cache/dbn" : "");
+    unsigned sensor_cache = 256;
+    bool prewarm = false;
+    unsigned dense_limit = 1024;
+    long reordering = 0;
+    double epsilon = 0.0;
+    string statistics_file;
+    string output_file, output_format = "csv";
+    string profile_file;
+    size_t mem_limit = 0;
+    string mem_fallback = "fail";
+    if (read_options(argc, argv, verbose, m1, m2, m3, m4, m5, heuristic, cache_dir, sensor_cache, prewarm, dense_limit, reordering, epsilon, statistics_file, output_file, output_format, profile_file, mem_limit, mem_fallback)) return -1;
+    Profiler::enable(profile_file != "");
+    set_elimination_heuristic(heuristic);
+    set_sensor_cache(sensor_cache, prewarm);
+    set_dense_limit(dense_limit);
+    set_reordering_threshold(reordering);
+    set_approximation(epsilon);
 
     unsigned order;
     vector<unique_ptr<Variable>> variables;
     vector<shared_ptr<Factor>> factors;
-    vector<shared_ptr<ADDFactor>> addfactors;
+    vector<shared_ptr<EVDDFactor>> evddfactors;
 
     set<unsigned> interface;
     set<unsigned> sensor;
     set<unsigned> prior;
     set<unsigned> internals;
+    set<unsigned> forward_interface;
 
     unordered_map<unsigned,const Variable*> transition;
 
-    // READ MODEL FROM FILE
-    if (read_uai_model(model, order, variables, factors, addfactors, prior, interface, sensor, internals, transition)) return -2;
+    // READ MODEL FROM FILE (text or compiled)
+    ScopedPhase load_phase(Profiler::MODEL_LOAD);
+    unique_ptr<ModelImage> image;
+    if (is_model_image(model)) {
+        image.reset(new ModelImage(model));
+        if (image->read_model(order, variables, factors, prior, interface, sensor, internals, transition, forward_interface)) return -2;
+    }
+    else if (read_uai_model(model, order, variables, factors, prior, interface, sensor, internals, transition, forward_interface)) return -2;
+
+    // PLAN ELIMINATION ORDERINGS (cached by model structure)
+    Planner planner(structure_hash(variables, factors, sensor, transition, heuristic), cache_dir);
 
     unsigned nvariables = variables.size();
     unsigned interface_width = transition.size();
     unsigned observation_width = sensor.size();
     unsigned internals_width = internals.size();
 
+    double belief_size = 1.0, forward_size = 1.0;
+    for (auto it_transition : transition) {
+        const Variable *curr = it_transition.second;
+        belief_size *= curr->size();
+        if (forward_interface.count(curr->id())) forward_size *= curr->size();
+    }
+
     if (verbose) {
         cout << ">> NETWORK: " << model << endl;
         cout << "number of interface variables   = " << interface_width << endl;
+        cout << "number of forward interface variables = " << forward_interface.size();
+        cout << " (belief state size " << belief_size << " -> " << forward_size << ")" << endl;
         cout << "number of observation variables = " << observation_width << endl;
         cout << "number of internal variables    = " << internals_width << endl;
         cout << "total number of variables       = " << nvariables << endl;
@@ -92,102 +178,328 @@ int main(int argc, char *argv[])
         // cout << endl;
     }
 
-    // READ EVIDENCE FROM FILE
-    vector<unordered_map<unsigned,unsigned>> observations;
-    set<unsigned> state_variables;
-    if (read_observations(evidence, observations, state_variables)) return -3;
-    int T = observations.size();
-    if (verbose) {
-        cout << ">> OBSERVATIONS: " << evidence << endl;
-        cout << "number of timeslices = " << T << endl << endl;
-        // print_observations(observations);
-        // cout << endl;
-    }
-
     vector<const Variable*> vars;
     for (auto const &v : variables) {
         vars.push_back(v.get());
     }
 
+    // EVIDENCE: a row-major stream is filtered as it is read, by a single method
+    unique_ptr<EvidenceStream> stream;
+    Evidence observations;
+    set<unsigned> state_variables;
+    if (is_evidence_stream(evidence)) {
+        stream.reset(new EvidenceStream(evidence));
+        if (!stream->is_open() || !stream->bind(vars)) return -3;
+        if (m1 || m2 + m3 + m4 + m5 != 1) {
+            cerr << "Error: an evidence stream is filtered by exactly one of the methods 2, 3, 4 or 5" << endl;
+            return -1;
+        }
+        state_variables = stream->state_variables();
+        if (verbose) {
+            cout << ">> EVIDENCE STREAM: " << evidence << endl << endl;
+        }
+    }
+    else {
+        if (read_observations(evidence, variables, observations, state_variables)) return -3;
+        if (verbose) {
+            cout << ">> OBSERVATIONS: " << evidence << endl;
+            cout << "number of timeslices = " << observations.timesteps() << " (" << observations.memory() << " bytes)" << endl << endl;
+            // print_observations(observations);
+            // cout << endl;
+        }
+    }
+    auto source = [&]() -> EvidenceSource {
+        if (stream) return [&stream](EvidenceRow &row) { return stream->next(row); };
+        return replay(observations);
+    };
+
+    // OUTPUT: marginals of the state variables, written as they are computed
+    vector<const Variable*> state_scope;
+    for (auto it_transition : transition) {
+        const Variable *curr = it_transition.second;
+        if (state_variables.count(curr->id())) state_scope.push_back(curr);
+    }
+    sort(state_scope.begin(), state_scope.end(), [](const Variable *v1, const Variable *v2) { return v1->id() < v2->id(); });
+    const Domain state_domain(state_scope);
+
+    if (output_file == "" && stream && verbose) output_file = "-";
+    unique_ptr<MarginalSink> output;
+    if (output_file != "") {
+        output.reset(MarginalSink::open(output_file, output_format, state_domain));
+        if (!output) return -4;
+    }
+    bool keep = (verbose && !output);
+
+    // model and evidence loading, apart from the profiles of the methods
+    load_phase.stop();
+    Profile load_profile = Profiler::collect();
+    vector<pair<unsigned,Profile>> profiles;
+
+    // MEMORY BUDGET: loaded model and evidence count against the limit. A
+    // method that would exceed it stops with a report and ends the run, or
+    // with --mem-fallback approximate is replaced by approximate filtering
+    // with ADDs, once the other methods are done.
+    MemoryAccountant::limit(mem_limit);
+    double fallback_epsilon = (epsilon > 0.0 ? epsilon : 1e-3);
+    bool fallback = false;
+    auto over_budget = [&](unsigned method) {
+        if (mem_fallback != "approximate" || stream || (method == 3 && epsilon > 0.0)) return true;
+        if (!fallback) cerr << "falling back to approximate filtering with ADDs (reported as method " << APPROXIMATE_FALLBACK << ", tolerance " << fallback_epsilon << ")" << endl;
+        fallback = true;
+        return false;
+    };
+
     // COMPUTE FILTERING
     if (m1) {
+        Estimates<Factor> estimates(1, output.get(), state_domain, keep);
+        FilteringRun run;
+        run.planner = &planner;
         auto start = chrono::steady_clock::now();
-        vector<shared_ptr<Factor>> states1 = unrolled_filtering(vars, factors, prior, sensor, internals, transition, observations);
+        vector<shared_ptr<Factor>> states1;
+        bool completed = within_budget(1, [&]() {
+            states1 = unrolled_filtering(vars, factors, prior, sensor, internals, transition, observations, false, &run);
+        });
         auto end = chrono::steady_clock::now();
         auto diff = end - start;
+        ScopedPhase output_phase(Profiler::OUTPUT);
+        for (auto &pf : states1) {
+            estimates.add(*pf);
+        }
+        output_phase.stop();
+        unsigned T = max(estimates.steps, 1u);
 
-        if (verbose) {
+        if (!completed) {
+            if (over_budget(1)) return -5;
+        }
+        else if (verbose) {
             cout << ">> UNROLLED VARIABLE ELIMINATION:" << endl;
             cout << "total time = " << chrono::duration <double, milli> (diff).count() << " ms, ";
             cout << "time per slice = " << chrono::duration <double, milli> (diff).count() / T << " ms." << endl;
-            print_trajectory<Factor>(states1, state_variables);
+            cout << "induced width = " << run.induced_width << endl;
+            if (keep) print_trajectory<Factor>(estimates.states, state_variables);
             cout << endl;
         }
         else {
             cout << model << ";";
             cout << 1 << ";";
-            cout << T << ";";
+            cout << estimates.steps << ";";
             cout << nvariables << ";" << interface_width << ";" << observation_width << ";" << internals_width << ";";
             cout << chrono::duration <double, milli> (diff).count() << ";";
             cout << chrono::duration <double, milli> (diff).count() / T << ";";
-            cout << 0.0 << ";" << 0.0 << ";" << endl;
+            cout << 0.0 << ";" << 0.0 << ";" << 0.0 << ";";
+            ADDStatistics().print_columns(cout);
+            cout << endl;
         }
+        if (Profiler::enabled()) profiles.emplace_back(estimates.method, Profiler::collect());
     }
 
     if (m2) {
+        Estimates<Factor> estimates(2, output.get(), state_domain, keep);
+        FilteringRun run;
+        run.planner = &planner;
         auto start = chrono::steady_clock::now();
-        vector<shared_ptr<Factor>> states2 = filtering(vars, factors, prior, sensor, internals, transition, observations);
+        bool completed = within_budget(2, [&]() {
+            filtering(vars, factors, prior, sensor, internals, transition, forward_interface, source(), estimates.sink(), &run);
+        });
         auto end = chrono::steady_clock::now();
         auto diff = end - start;
+        unsigned T = max(estimates.steps, 1u);
 
-        if (verbose) {
+        if (!completed) {
+            if (over_budget(2)) return -5;
+        }
+        else if (verbose) {
             cout << ">> INTERFACE:" << endl;
             cout << "total time = " << chrono::duration <double, milli> (diff).count() << " ms, ";
             cout << "time per slice = " << chrono::duration <double, milli> (diff).count() / T << " ms." << endl;
-            print_trajectory<Factor>(states2, state_variables);
+            cout << "induced width = " << run.induced_width << endl;
+            cout << "sensor cache hits = " << run.sensor_cache_hits << ", misses = " << run.sensor_cache_misses << endl;
+            if (run.dense_fast_path) cout << "dense HMM fast path (" << DenseHMM::states(transition) << " states)" << endl;
+            if (keep) print_trajectory<Factor>(estimates.states, state_variables);
             cout << endl;
         }
         else {
             cout << model << ";";
             cout << 2 << ";";
-            cout << T << ";";
+            cout << estimates.steps << ";";
             cout << nvariables << ";" << interface_width << ";" << observation_width << ";" << internals_width << ";";
             cout << chrono::duration <double, milli> (diff).count() << ";";
             cout << chrono::duration <double, milli> (diff).count() / T << ";";
-            cout << 0.0 << ";" << 0.0 << ";" << endl;
+            cout << 0.0 << ";" << 0.0 << ";" << 0.0 << ";";
+            ADDStatistics().print_columns(cout);
+            cout << endl;
         }
+        if (Profiler::enabled()) profiles.emplace_back(estimates.method, Profiler::collect());
     }
 
-    if (m3) {
+    // interface algorithm with ADDs, also the approximate fallback (tagged
+    // as its own method); returns false when it stopped over the budget
+    auto add_filtering = [&](unsigned method) {
+        // decision diagrams of this run, released with the context
+        ADDContext context;
+        vector<shared_ptr<ADDFactor>> addfactors;
+        bool completed = within_budget(method, [&]() {
+            if (!image || !image->has_addfactors() || image->read_addfactors(context, variables, factors, addfactors)) {
+                addfactors.clear();
+                read_addfactors(context, factors, transition, addfactors);
+            }
+        });
+        Estimates<ADDFactor> estimates(method, output.get(), state_domain, keep);
+        FilteringRun run;
+        run.planner = &planner;
         auto start = chrono::steady_clock::now();
-        vector<shared_ptr<ADDFactor>> states3 = filtering(vars, addfactors, prior, sensor, internals, transition, observations);
+        completed = completed && within_budget(method, [&]() {
+            filtering(vars, addfactors, prior, sensor, internals, transition, forward_interface, source(), estimates.sink(), &run);
+        });
         auto end = chrono::steady_clock::now();
         auto diff = end - start;
+        unsigned T = max(estimates.steps, 1u);
+
+        if (!completed) {
+            if (Profiler::enabled()) profiles.emplace_back(estimates.method, Profiler::collect());
+            return false;
+        }
+
+        if (statistics_file != "") {
+            ofstream output_file(statistics_file);
+            if (output_file.is_open()) {
+                context.write_statistics(output_file);
+            }
+            else {
+                cerr << "Error: couldn't write file " << statistics_file << endl;
+            }
+        }
 
         if (verbose) {
             cout << ">> INTERFACE with ADDs:" << endl;
             cout << "total time = " << chrono::duration <double, milli> (diff).count() << " ms, ";
             cout << "time per slice = " << chrono::duration <double, milli> (diff).count() / T << " ms." << endl;
-            print_trajectory<ADDFactor>(states3, state_variables);
+            cout << "induced width = " << run.induced_width << endl;
+            cout << "sensor cache hits = " << run.sensor_cache_hits << ", misses = " << run.sensor_cache_misses << endl;
+            cout << "belief state nodes: avg = " << estimates.avg_nodes / T << ", max = " << estimates.max_nodes << endl;
+            cout << "approximation error (sum of per-step L-infinity merge errors) = " << run.approximation_error << endl;
+            ADDStatistics stats = context.statistics();
+            cout << "ADD manager: peak live nodes = " << stats.peak_live_nodes;
+            cout << ", cache hit rate = " << stats.cache_hit_rate();
+            cout << ", GCs = " << stats.garbage_collections << " (" << stats.garbage_collection_time << " ms)";
+            cout << ", reorderings = " << stats.reorderings << " (" << stats.reordering_time << " ms)";
+            cout << ", memory = " << stats.memory << " bytes" << endl;
+            if (keep) print_trajectory<ADDFactor>(estimates.states, state_variables);
             cout << endl;
         }
         else {
             cout << model << ";";
-            cout << 3 << ";";
-            cout << T << ";";
+            cout << estimates.method << ";";
+            cout << estimates.steps << ";";
             cout << nvariables << ";" << interface_width << ";" << observation_width << ";" << internals_width << ";";
             cout << chrono::duration <double, milli> (diff).count() << ";";
             cout << chrono::duration <double, milli> (diff).count() / T << ";";
+            cout << estimates.avg_compactation / T << ";" << estimates.max_compactation << ";" << run.approximation_error << ";";
+            context.statistics().print_columns(cout);
+            cout << endl;
+        }
+        if (Profiler::enabled()) profiles.emplace_back(estimates.method, Profiler::collect());
+        return completed;
+    };
+    if (m3 && !add_filtering(3) && over_budget(3)) return -5;
+
+    if (m4) {
+        Estimates<Factor> estimates(4, output.get(), state_domain, keep);
+        FilteringRun run;
+        run.planner = &planner;
+        auto start = chrono::steady_clock::now();
+        bool completed = within_budget(4, [&]() {
+            junction_tree_filtering(vars, factors, prior, sensor, internals, transition, source(), estimates.sink(), &run);
+        });
+        auto end = chrono::steady_clock::now();
+        auto diff = end - start;
+        unsigned T = max(estimates.steps, 1u);
 
-            double avg_compactation = 0.0, max_compactation = 0.0;
-            for (auto &pf : states3) {
-                double c = pf->compactation();
-                avg_compactation += c;
-                max_compactation = (max_compactation < c ? c : max_compactation);
-            }
-            avg_compactation /= T;
-            cout << avg_compactation << ";" << max_compactation << ";" << endl;
+        if (!completed) {
+            if (over_budget(4)) return -5;
+        }
+        else if (verbose) {
+            cout << ">> JUNCTION TREE:" << endl;
+            cout << "total time = " << chrono::duration <double, milli> (diff).count() << " ms, ";
+            cout << "time per slice = " << chrono::duration <double, milli> (diff).count() / T << " ms." << endl;
+            cout << "induced width = " << run.induced_width << endl;
+            if (keep) print_trajectory<Factor>(estimates.states, state_variables);
+            cout << endl;
+        }
+        else {
+            cout << model << ";";
+            cout << 4 << ";";
+            cout << estimates.steps << ";";
+            cout << nvariables << ";" << interface_width << ";" << observation_width << ";" << internals_width << ";";
+            cout << chrono::duration <double, milli> (diff).count() << ";";
+            cout << chrono::duration <double, milli> (diff).count() / T << ";";
+            cout << 0.0 << ";" << 0.0 << ";" << 0.0 << ";";
+            ADDStatistics().print_columns(cout);
+            cout << endl;
+        }
+        if (Profiler::enabled()) profiles.emplace_back(estimates.method, Profiler::collect());
+    }
+
+    if (m5) {
+        bool completed = within_budget(5, [&]() { read_evddfactors(factors, transition, evddfactors); });
+        Estimates<EVDDFactor> estimates(5, output.get(), state_domain, keep);
+        FilteringRun run;
+        run.planner = &planner;
+        auto start = chrono::steady_clock::now();
+        completed = completed && within_budget(5, [&]() {
+            filtering(vars, evddfactors, prior, sensor, internals, transition, forward_interface, source(), estimates.sink(), &run);
+        });
+        auto end = chrono::steady_clock::now();
+        auto diff = end - start;
+        unsigned T = max(estimates.steps, 1u);
+
+        if (!completed) {
+            if (over_budget(5)) return -5;
+        }
+        else if (verbose) {
+            cout << ">> INTERFACE with EVDDs:" << endl;
+            cout << "total time = " << chrono::duration <double, milli> (diff).count() << " ms, ";
+            cout << "time per slice = " << chrono::duration <double, milli> (diff).count() / T << " ms." << endl;
+            cout << "induced width = " << run.induced_width << endl;
+            cout << "sensor cache hits = " << run.sensor_cache_hits << ", misses = " << run.sensor_cache_misses << endl;
+            cout << "belief state nodes: avg = " << estimates.avg_nodes / T << ", max = " << estimates.max_nodes << endl;
+            if (keep) print_trajectory<EVDDFactor>(estimates.states, state_variables);
+            cout << endl;
+        }
+        else {
+            cout << model << ";";
+            cout << 5 << ";";
+            cout << estimates.steps << ";";
+            cout << nvariables << ";" << interface_width << ";" << observation_width << ";" << internals_width << ";";
+            cout << chrono::duration <double, milli> (diff).count() << ";";
+            cout << chrono::duration <double, milli> (diff).count() / T << ";";
+            cout << estimates.avg_compactation / T << ";" << estimates.max_compactation << ";" << 0.0 << ";";
+            ADDStatistics().print_columns(cout);
+            cout << endl;
         }
+        if (Profiler::enabled()) profiles.emplace_back(estimates.method, Profiler::collect());
+    }
+
+    if (fallback) {
+        set_approximation(fallback_epsilon);
+        if (!add_filtering(APPROXIMATE_FALLBACK)) return -5;
+    }
+
+    if (profile_file != "") {
+        ofstream output(profile_file);
+        if (output.is_open()) {
+            write_profiles(output, load_profile, profiles);
+        }
+        else {
+            cerr << "Error: couldn't write file " << profile_file << endl;
+        }
+    }
+
+    if (verbose) {
+        cout << ">> ELIMINATION PLANS: cache hits = " << planner.hits() << ", misses = " << planner.misses() << endl;
+        cout << ">> MEMORY: peak = " << MemoryAccountant::peak() << " bytes";
+        if (mem_limit) cout << " (limit " << mem_limit << " bytes)";
+        cout << endl;
     }
 
     return 0;
@@ -197,26 +509,85 @@ void
 usage(const char *filename)
 {
     string usage = "Usage: " + string(filename) + " /path/to/model.duai /path/to/observations.duai.evid [OPTIONS]";
-    cout << usage << endl << endl;
+    cout << usage << endl;
+    cout << "       " << filename << " compile /path/to/model.duai -o /path/to/model.dbnb [-a]" << endl << endl;
 
     cout << "Filtering methods (-m option):" << endl;
     cout << "(1) variable elimination in unrolled network" << endl;
     cout << "(2) interface algorithm" << endl;
     cout << "(3) interface algorithm with ADDs" << endl;
+    cout << "(4) 1.5-slice junction tree" << endl;
+    cout << "(5) interface algorithm with edge-valued decision diagrams" << endl;
     cout << endl;
 
     cout << "OPTIONS:" << endl;
-    cout << "-m filtering method (1|2|3)" << endl;
+    cout << "-m filtering method (1|2|3|4|5)" << endl;
+    cout << "-o elimination ordering heuristic (min-fill|min-degree|weighted-min-fill)" << endl;
+    cout << "-c elimination plan cache directory (default: $HOME/.cache/dbn, 'none' disables)" << endl;
+    cout << "-s sensor likelihood cache capacity (default: 256, 0 disables)" << endl;
+    cout << "-w prewarm sensor likelihood cache" << endl;
+    cout << "-d max number of interface states for the dense HMM fast path (default: 1024, 0 disables)" << endl;
+    cout << "-r ADD node count that triggers group sifting between timesteps (default: 0, disabled)" << endl;
+    cout << "-e ADD leaf merging tolerance for approximate filtering (default: 0, exact)" << endl;
+    cout << "-j file for ADD manager statistics (JSON, total and per step)" << endl;
+    cout << "-p file for the per-phase profile of each method (JSON, total and per step)" << endl;
+    cout << "--mem-limit memory budget in bytes, with an optional K, M or G suffix (default: none)" << endl;
+    cout << "--mem-fallback when a method would exceed the budget (fail|approximate, default: fail)" << endl;
+    cout << "-O file for the marginals of the state variables at each step ('-' for stdout)" << endl;
+    cout << "-f format of the marginals file (csv|binary, default: csv)" << endl;
     cout << "-v verbose" << endl;
+    cout << endl;
+
+    cout << "Compiled models (.dbnb) are accepted in place of .duai files; -a also stores the ADDs." << endl;
+    cout << "Evidence streams (.duai.stream, or - for stdin) are filtered by one of the methods 2-5." << endl;
+}
+
+int
+compile(int argc, char *argv[])
+{
+    const char *model = nullptr;
+    string output;
+    bool adds = false;
+    for (int i = 2; i < argc; ++i) {
+        string option(argv[i]);
+        if (option == "-o" && i+1 < argc) output = argv[++i];
+        else if (option == "-a") adds = true;
+        else if (!model) model = argv[i];
+        else {
+            cerr << "Error: unexpected argument " << option << endl;
+            return -1;
+        }
+    }
+    if (!model || output == "") {
+        usage(argv[0]);
+        return -1;
+    }
+
+    unsigned order;
+    vector<unique_ptr<Variable>> variables;
+    vector<shared_ptr<Factor>> factors;
+    set<unsigned> interface, sensor, prior, internals, forward_interface;
+    unordered_map<unsigned,const Variable*> transition;
+    if (read_uai_model(model, order, variables, factors, prior, interface, sensor, internals, transition, forward_interface)) return -2;
+
+    return write_model_image(output.c_str(), variables, factors, sensor, internals, transition, forward_interface, adds);
 }
 
 int
-read_options(int argc, char *argv[], bool &verbose, bool &m1, bool &m2, bool &m3)
+read_options(int argc, char *argv[], bool &verbose, bool &m1, bool &m2, bool &m3, bool &m4, bool &m5, Graph::Heuristic &heuristic, string &cache_dir, unsigned &sensor_cache, bool &prewarm, unsigned &dense_limit, long &reordering, double &epsilon, string &statistics_file, string &output_file, string &output_format, string &profile_file, size_t &mem_limit, string &mem_fallback)
 {
     if (argc >= 4) {
         for (int i = 3; i < argc; ++i) {
             string option(argv[i]);
+            // options that take the next argument as their value
+            static const set<string> valued = { "-m", "-c", "-s", "-d", "-r", "-e", "-j", "-p", "--mem-limit", "--mem-fallback", "-O", "-f", "-o" };
+            if (valued.count(option) && i+1 >= argc) {
+                cerr << "Error: missing value for option " << option << endl;
+                usage(argv[0]);
+                return -1;
+            }
             if (option == "-v") verbose = true;
+            else if (option == "-w") prewarm = true;
             else if (option == "-m") {
                 char *m = argv[i+1];
                 for (unsigned j = 0; j < strlen(m); ++j) {
@@ -224,12 +595,73 @@ read_options(int argc, char *argv[], bool &verbose, bool &m1, bool &m2, bool &m3
                         case '1': m1 = true; break;
                         case '2': m2 = true; break;
                         case '3': m3 = true; break;
+                        case '4': m4 = true; break;
+                        case '5': m5 = true; break;
                         default:
                             cerr << "Error: wrong method option " << m << endl;
                             return -1;
                     }
                 }
             }
+            else if (option == "-c") {
+                cache_dir = argv[i+1];
+                if (cache_dir == "none") cache_dir = "";
+            }
+            else if (option == "-s") {
+                sensor_cache = atoi(argv[i+1]);
+            }
+            else if (option == "-d") {
+                dense_limit = atoi(argv[i+1]);
+            }
+            else if (option == "-r") {
+                reordering = atol(argv[i+1]);
+            }
+            else if (option == "-e") {
+                epsilon = atof(argv[i+1]);
+            }
+            else if (option == "-j") {
+                statistics_file = argv[i+1];
+            }
+            else if (option == "-p") {
+                profile_file = argv[i+1];
+            }
+            else if (option == "--mem-limit") {
+                char *end;
+                double bytes = strtod(argv[i+1], &end);
+                string unit(end);
+                if (unit == "K" || unit == "k") bytes *= 1024.0;
+                else if (unit == "M" || unit == "m") bytes *= 1024.0 * 1024.0;
+                else if (unit == "G" || unit == "g") bytes *= 1024.0 * 1024.0 * 1024.0;
+                else if (unit != "") bytes = -1.0;
+                if (end == argv[i+1] || bytes < 0.0) {
+                    cerr << "Error: wrong memory limit " << argv[i+1] << endl;
+                    return -1;
+                }
+                mem_limit = bytes;
+            }
+            else if (option == "--mem-fallback") {
+                mem_fallback = argv[i+1];
+                if (mem_fallback != "fail" && mem_fallback != "approximate") {
+                    cerr << "Error: wrong memory fallback option " << mem_fallback << endl;
+                    return -1;
+                }
+            }
+            else if (option == "-O") {
+                output_file = argv[i+1];
+            }
+            else if (option == "-f") {
+                output_format = argv[i+1];
+            }
+            else if (option == "-o") {
+                string o(argv[i+1]);
+                if (o == "min-fill") heuristic = Graph::MIN_FILL;
+                else if (o == "min-degree") heuristic = Graph::MIN_DEGREE;
+                else if (o == "weighted-min-fill") heuristic = Graph::WEIGHTED_MIN_FILL;
+                else {
+                    cerr << "Error: wrong ordering option " << o << endl;
+                    return -1;
+                }
+            }
         }
     }
     return 0;
@@ -277,17 +709,18 @@ print_model(
 }
 
 void
-print_observations(vector<unordered_map<unsigned,unsigned>> &observations)
+print_observations(const Evidence &observations)
 {
     cout << "=== Observations ===" << endl;
     cout.precision(3);
     cout << fixed;
-    unsigned T = observations.size();
+    unsigned T = observations.timesteps();
     for (unsigned t = 1; t <= T; ++t) {
         cout << "@t = " << t << " {";
-        for (auto it_evidence : observations[t-1]) {
-            unsigned id = it_evidence.first;
-            unsigned value = it_evidence.second;
+        for (unsigned i = 0; i < observations.width(); ++i) {
+            unsigned id = observations.variables()[i];
+            Evidence::value_type value = observations.value(t-1, i);
+            if (value == Evidence::MISSING) continue;
             cout << " " << id << ":" << value;
         }
         cout << " }" << endl;
@@ -295,6 +728,41 @@ print_observations(vector<unordered_map<unsigned,unsigned>> &observations)
     cout << endl;
 }
 
+void
+write_profiles(ostream &os, const Profile &load, const vector<pair<unsigned,Profile>> &profiles)
+{
+    os << "{" << endl;
+    os << "  \"model_load\": ";
+    load.total.write_json(os);
+    os << "," << endl;
+    os << "  \"methods\": [";
+    for (unsigned i = 0; i < profiles.size(); ++i) {
+        os << (i ? "," : "") << endl;
+        os << "    {\"method\": " << profiles[i].first << ", \"profile\": ";
+        profiles[i].second.write_json(os, "    ");
+        os << "}";
+    }
+    os << endl << "  ]" << endl;
+    os << "}" << endl;
+}
+
+// runs a filtering method, reporting an allocation that would exceed the
+// memory budget instead of letting it fail; estimates already written are
+// kept. Returns whether the method completed.
+bool
+within_budget(unsigned method, function<void()> filter)
+{
+    try {
+        filter();
+        return true;
+    }
+    catch (const MemoryLimitExceeded &e) {
+        e.report(cerr);
+        cerr << "method " << method << " stopped before completing the filtering" << endl;
+        return false;
+    }
+}
+
 template<class T>
 void
 print_trajectory(vector<shared_ptr<T>> &states, set<unsigned> &state_variables, bool verbose)
@@ -327,6 +795,12 @@ print_trajectory(vector<shared_ptr<T>> &states, set<unsigned> &state_variables,
     cout.precision(3);
     cout << fixed;
 
+    // evaluate each estimate on all instantiations at once
+    vector<vector<double>> trajectory;
+    for (auto const& pf : states) {
+        trajectory.push_back(pf->values(domain));
+    }
+
     std::vector<unsigned> inst(domain.width(), 0);
     for (unsigned i = 0; i < domain.size(); ++i) {
 
@@ -337,17 +811,8 @@ print_trajectory(vector<shared_ptr<T>> &states, set<unsigned> &state_variables,
         cout << ":";
 
         // print value trajectory
-        for (auto const& pf : states) {
-            const Domain &d = pf->domain();
-            unsigned w = d.width();
-            std::vector<unsigned> inst2(w, 0);
-
-            for (unsigned j = 0; j < w; ++j) {
-                const Variable *v = d[j];
-                inst2[j] = inst[domain[v]];
-            }
-
-            cout << " " << (*pf)[inst2];
+        for (auto const& values : trajectory) {
+            cout << " " << values[i];
         }
         cout << endl;
 
@@ -362,3 +827,28 @@ print_trajectory(vector<shared_ptr<T>> &states, set<unsigned> &state_variables,
         }
     }
 }
+
+static double compactation(const Factor &) { return 0.0; }
+static double node_count(const Factor &) { return 0.0; }
+
+template<class T>
+static double compactation(const T &f) { return f.compactation(); }
+
+template<class T>
+static double node_count(const T &f) { return f.node_count(); }
+
+template<class T>
+void
+Estimates<T>::add(const T &belief_state)
+{
+    ++steps;
+    double c = compactation(belief_state);
+    avg_compactation += c;
+    max_compactation = (max_compactation < c ? c : max_compactation);
+    double n = node_count(belief_state);
+    avg_nodes += n;
+    max_nodes = (max_nodes < n ? n : max_nodes);
+
+    if (output) output->write(method, steps, marginal(belief_state, domain));
+    if (keep) states.push_back(make_shared<T>(belief_state));
+}
@@ -0,0 +1,59 @@
+// Copyright (c) 2015 Thiago Pereira Bueno
+// All Rights Reserved.
+//
+// This file is part of DBN library.
+//
+// DBN is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// DBN is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DBN.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "mappedfile.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace dbn {
+
+	MappedFile::MappedFile(const char *filename, bool sequential) : _data(nullptr), _size(0), _mapped(false), _open(false) {
+		int fd = open(filename, O_RDONLY);
+		if (fd < 0) return;
+		_open = true;
+
+		struct stat st;
+		if (fstat(fd, &st) == 0 && st.st_size > 0) {
+			void *p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (p != MAP_FAILED) {
+				madvise(p, st.st_size, sequential ? MADV_SEQUENTIAL : MADV_WILLNEED);
+				_data = static_cast<const char*>(p);
+				_size = st.st_size;
+				_mapped = true;
+			}
+		}
+		if (!_mapped) {
+			char chunk[1 << 16];
+			ssize_t n;
+			while ((n = read(fd, chunk, sizeof(chunk))) > 0) {
+				_buffer.insert(_buffer.end(), chunk, chunk + n);
+			}
+			_data = _buffer.data();
+			_size = _buffer.size();
+		}
+		close(fd);
+	}
+
+	MappedFile::~MappedFile() {
+		if (_mapped) munmap(const_cast<char*>(_data), _size);
+	}
+
+}
@@ -0,0 +1,125 @@
+// Copyright (c) 2015 Thiago Pereira Bueno
+// All Rights Reserved.
+//
+// This file is part of DBN library.
+//
+// DBN is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// DBN is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DBN.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "marginalsink.h"
+
+#include <iostream>
+#include <cstdio>
+#include <cstdint>
+
+using namespace std;
+
+namespace dbn {
+
+	static const uint32_t MARGINALS_VERSION = 1;
+
+	class FileSink : public MarginalSink {
+	public:
+		FileSink(const string &filename, bool binary) : _file(nullptr), _close(false) {
+			if (filename == "-") {
+				_file = stdout;
+			}
+			else {
+				// buffering can only be set before the first output, so
+				// stdout (possibly written to already) keeps its own
+				_file = fopen(filename.c_str(), binary ? "wb" : "w");
+				_close = true;
+				if (_file) setvbuf(_file, nullptr, _IOFBF, 1 << 16);
+			}
+		}
+
+		~FileSink() {
+			if (_close && _file) fclose(_file);
+			else if (_file) fflush(_file);
+		}
+
+		bool is_open() const { return _file != nullptr; }
+
+	protected:
+		FILE *_file;
+		bool _close;
+	};
+
+	class CSVSink : public FileSink {
+	public:
+		CSVSink(const string &filename, const Domain &domain) : FileSink(filename, false) {
+			if (!_file) return;
+			fputs("method,t", _file);
+			vector<unsigned> inst(domain.width(), 0);
+			for (unsigned i = 0; i < domain.size(); ++i) {
+				fputc(',', _file);
+				for (unsigned j = 0; j < domain.width(); ++j) {
+					fprintf(_file, "%s%u=%u", (j ? " " : ""), domain[j]->id(), inst[j]);
+				}
+				domain.next_instantiation(inst);
+			}
+			fputc('\n', _file);
+		}
+
+		void write(unsigned method, unsigned t, const vector<double> &marginal) {
+			fprintf(_file, "%u,%u", method, t);
+			for (double value : marginal) {
+				fprintf(_file, ",%.6g", value);
+			}
+			fputc('\n', _file);
+		}
+	};
+
+	class BinarySink : public FileSink {
+	public:
+		BinarySink(const string &filename, const Domain &domain) : FileSink(filename, true), _record(domain.size()) {
+			if (!_file) return;
+			uint32_t header[] = { MARGINALS_VERSION, domain.width(), domain.size() };
+			fwrite("DBNM", 1, 4, _file);
+			fwrite(header, sizeof(uint32_t), 3, _file);
+			for (unsigned j = 0; j < domain.width(); ++j) {
+				uint32_t variable[] = { domain[j]->id(), domain[j]->size() };
+				fwrite(variable, sizeof(uint32_t), 2, _file);
+			}
+		}
+
+		void write(unsigned method, unsigned t, const vector<double> &marginal) {
+			uint32_t key[] = { method, t };
+			fwrite(key, sizeof(uint32_t), 2, _file);
+			for (unsigned i = 0; i < _record.size(); ++i) {
+				_record[i] = marginal[i];
+			}
+			fwrite(_record.data(), sizeof(float), _record.size(), _file);
+		}
+
+	private:
+		vector<float> _record;
+	};
+
+	MarginalSink *MarginalSink::open(const string &filename, const string &format, const Domain &domain) {
+		FileSink *sink = nullptr;
+		if (format == "csv") sink = new CSVSink(filename, domain);
+		else if (format == "binary") sink = new BinarySink(filename, domain);
+		else {
+			cerr << "Error: unknown marginals format " << format << endl;
+			return nullptr;
+		}
+		if (!sink->is_open()) {
+			cerr << "Error: couldn't write file " << filename << endl;
+			delete sink;
+			return nullptr;
+		}
+		return sink;
+	}
+
+}
@@ -0,0 +1,49 @@
+// Copyright (c) 2015 Thiago Pereira Bueno
+// All Rights Reserved.
+//
+// This file is part of DBN library.
+//
+// DBN is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// DBN is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DBN.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "memoryaccountant.h"
+
+#include <iomanip>
+
+using namespace std;
+
+namespace dbn {
+
+	atomic<size_t> MemoryAccountant::_current(0);
+	atomic<size_t> MemoryAccountant::_peak(0);
+	size_t MemoryAccountant::_limit = 0;
+
+	MemoryLimitExceeded::MemoryLimitExceeded(const string &what, double requested) :
+		runtime_error(what),
+		_requested(requested),
+		_current(MemoryAccountant::current()),
+		_peak(MemoryAccountant::peak()),
+		_limit(MemoryAccountant::limit()) { }
+
+	void MemoryLimitExceeded::report(ostream &os) const {
+		os << "Error: memory limit of " << _limit << " bytes exceeded by " << what() << endl;
+		ios::fmtflags flags = os.flags();
+		streamsize precision = os.precision();
+		os << fixed << setprecision(0);
+		if (_requested > 0.0) os << "requested = " << _requested << " bytes, ";
+		os << "in use = " << _current << " bytes, peak = " << _peak << " bytes" << endl;
+		os.flags(flags);
+		os.precision(precision);
+	}
+
+}
@@ -0,0 +1,329 @@
+// Copyright (c) 2015 Thiago Pereira Bueno
+// All Rights Reserved.
+//
+// This file is part of DBN library.
+//
+// DBN is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// DBN is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DBN.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "modelimage.h"
+#include "io.h"
+#include "domain.h"
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <set>
+#include <unordered_map>
+#include <memory>
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+
+namespace dbn {
+
+	static const char IMAGE_MAGIC[8] = { 'D', 'B', 'N', 'B', 'I', 'M', 'G', '\0' };
+
+	static const uint64_t ELEMENT_SIZE[IMAGE_SECTIONS] = {
+		sizeof(uint32_t), sizeof(uint32_t), sizeof(uint32_t), sizeof(uint32_t), sizeof(uint32_t),
+		sizeof(ImageFactor), sizeof(uint32_t), sizeof(uint32_t), sizeof(double), sizeof(uint32_t),
+		sizeof(int32_t), sizeof(ImageADD), sizeof(ADDFactor::Node)
+	};
+
+	template<class T>
+	static void append(vector<char> &bytes, const T &value) {
+		const char *p = reinterpret_cast<const char*>(&value);
+		bytes.insert(bytes.end(), p, p + sizeof(T));
+	}
+
+	bool is_model_image(const char *filename) {
+		char magic[sizeof(IMAGE_MAGIC)];
+		ifstream input(filename, ios::binary);
+		return input.read(magic, sizeof(magic)) && memcmp(magic, IMAGE_MAGIC, sizeof(magic)) == 0;
+	}
+
+	int write_model_image(
+		const char *filename,
+		const vector<unique_ptr<Variable>> &variables,
+		const vector<shared_ptr<Factor>> &factors,
+		const set<unsigned> &sensor, const set<unsigned> &internals,
+		const unordered_map<unsigned,const Variable*> &transition, const set<unsigned> &forward_interface,
+		bool adds) {
+
+		vector<char> sections[IMAGE_SECTIONS];
+
+		for (auto const &v : variables) {
+			append<uint32_t>(sections[CARDINALITIES], v->size());
+		}
+
+		// interface pairs in order of current variable
+		vector<pair<uint32_t,uint32_t>> pairs;
+		for (auto it_transition : transition) {
+			pairs.emplace_back(it_transition.second->id(), it_transition.first);
+		}
+		sort(pairs.begin(), pairs.end());
+		for (auto const &p : pairs) {
+			append<uint32_t>(sections[TRANSITIONS], p.first);
+			append<uint32_t>(sections[TRANSITIONS], p.second);
+		}
+
+		for (unsigned id : sensor) append<uint32_t>(sections[SENSOR], id);
+		for (unsigned id : internals) append<uint32_t>(sections[INTERNALS], id);
+		for (unsigned id : forward_interface) append<uint32_t>(sections[FORWARD_INTERFACE], id);
+
+		// each value block starts on an aligned boundary
+		const uint64_t block = IMAGE_ALIGNMENT / sizeof(double);
+		uint64_t nscope = 0, nvalues = 0;
+		for (auto const &f : factors) {
+			const Domain &domain = f->domain();
+			nvalues = (nvalues + block - 1) / block * block;
+			sections[VALUES].resize(nvalues * sizeof(double), 0);
+
+			ImageFactor record { domain.width(), (uint32_t) nscope, domain.size(), nvalues, f->partition() };
+			append(sections[FACTORS], record);
+			for (unsigned i = 0; i < domain.width(); ++i) {
+				append<uint32_t>(sections[SCOPES], domain[i]->id());
+				append<uint32_t>(sections[STRIDES], domain.offset(i));
+			}
+			nscope += domain.width();
+
+			const Factor &factor = *f;
+			for (unsigned j = 0; j < domain.size(); ++j) {
+				append<double>(sections[VALUES], factor[j]);
+			}
+			nvalues += domain.size();
+		}
+
+		for (auto const &group : variable_groups(factors, transition)) {
+			append<uint32_t>(sections[GROUPS], group.size());
+			for (auto pv : group) {
+				append<uint32_t>(sections[GROUPS], pv->id());
+			}
+		}
+
+		if (adds) {
+			ADDContext context;
+			vector<shared_ptr<ADDFactor>> addfactors;
+			read_addfactors(context, factors, transition, addfactors);
+
+			// bits in order of allocation, so that a loader allocating them
+			// in this order gets the same indices
+			vector<const Variable*> allocated;
+			for (auto const &v : variables) allocated.push_back(v.get());
+			sort(allocated.begin(), allocated.end(),
+				[&context](const Variable *v1, const Variable *v2) { return context.bits(v1)[0] < context.bits(v2)[0]; });
+			for (auto pv : allocated) {
+				const vector<int> &indices = context.bits(pv);
+				append<int32_t>(sections[ADD_ENCODING], pv->id());
+				append<int32_t>(sections[ADD_ENCODING], indices.size());
+				for (int index : indices) {
+					append<int32_t>(sections[ADD_ENCODING], index);
+				}
+			}
+
+			uint64_t first = 0;
+			for (auto const &addf : addfactors) {
+				vector<ADDFactor::Node> nodes = addf->nodes();
+				append(sections[ADD_FACTORS], ImageADD { first, nodes.size() });
+				for (auto const &node : nodes) {
+					append(sections[ADD_NODES], node);
+				}
+				first += nodes.size();
+			}
+		}
+
+		// header, then each section on an aligned boundary
+		ImageHeader header;
+		memset(&header, 0, sizeof(header));
+		memcpy(header.magic, IMAGE_MAGIC, sizeof(IMAGE_MAGIC));
+		header.version = IMAGE_VERSION;
+		header.byte_order = IMAGE_BYTE_ORDER;
+		uint64_t offset = sizeof(header);
+		for (unsigned s = 0; s < IMAGE_SECTIONS; ++s) {
+			offset = (offset + IMAGE_ALIGNMENT - 1) / IMAGE_ALIGNMENT * IMAGE_ALIGNMENT;
+			header.sections[s].offset = offset;
+			header.sections[s].count = sections[s].size() / ELEMENT_SIZE[s];
+			offset += sections[s].size();
+		}
+
+		ofstream output(filename, ios::binary | ios::trunc);
+		if (!output.is_open()) {
+			cerr << "Error: couldn't write file " << filename << endl;
+			return -1;
+		}
+		output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		uint64_t position = sizeof(header);
+		for (unsigned s = 0; s < IMAGE_SECTIONS; ++s) {
+			vector<char> padding(header.sections[s].offset - position, 0);
+			output.write(padding.data(), padding.size());
+			output.write(sections[s].data(), sections[s].size());
+			position = header.sections[s].offset + sections[s].size();
+		}
+		if (!output) {
+			cerr << "Error: couldn't write file " << filename << endl;
+			return -1;
+		}
+		return 0;
+	}
+
+	ModelImage::ModelImage(const char *filename) :
+		_file(make_shared<MappedFile>(filename, false)),
+		_header(nullptr) {
+
+		if (!_file->is_open()) {
+			cerr << "Error: couldn't read file " << filename << endl;
+			return;
+		}
+
+		const ImageHeader *header = reinterpret_cast<const ImageHeader*>(_file->begin());
+		if (_file->size() < sizeof(ImageHeader) || memcmp(header->magic, IMAGE_MAGIC, sizeof(IMAGE_MAGIC)) != 0) {
+			cerr << "Error: " << filename << " is not a compiled model" << endl;
+			return;
+		}
+		if (header->version != IMAGE_VERSION || header->byte_order != IMAGE_BYTE_ORDER) {
+			cerr << "Error: " << filename << " was compiled by another version or on another architecture, recompile it" << endl;
+			return;
+		}
+		for (unsigned s = 0; s < IMAGE_SECTIONS; ++s) {
+			uint64_t offset = header->sections[s].offset;
+			uint64_t count = header->sections[s].count;
+			if (offset % IMAGE_ALIGNMENT || offset > _file->size() || count > (_file->size() - offset) / ELEMENT_SIZE[s]) {
+				cerr << "Error: " << filename << " is truncated or corrupt" << endl;
+				return;
+			}
+		}
+		_header = header;
+	}
+
+	bool ModelImage::has_addfactors() const {
+		return _header && count(ADD_FACTORS) > 0;
+	}
+
+	int ModelImage::read_model(
+		unsigned &order,
+		vector<unique_ptr<Variable>> &variables,
+		vector<shared_ptr<Factor>> &factors,
+		set<unsigned> &prior, set<unsigned> &interface, set<unsigned> &sensor, set<unsigned> &internals,
+		unordered_map<unsigned,const Variable*> &transition, set<unsigned> &forward_interface) const {
+
+		if (!_header) return -1;
+
+		order = count(CARDINALITIES);
+		const uint32_t *cardinalities = section<uint32_t>(CARDINALITIES);
+		for (unsigned id = 0; id < order; ++id) {
+			variables.emplace_back(new Variable(id, cardinalities[id]));
+		}
+
+		const uint32_t *pairs = section<uint32_t>(TRANSITIONS);
+		for (uint64_t i = 0; i + 1 < count(TRANSITIONS); i += 2) {
+			unsigned curr = pairs[i], next = pairs[i+1];
+			if (curr >= order || next >= order) return -1;
+			prior.insert(curr);
+			interface.insert(curr);
+			interface.insert(next);
+			transition[next] = variables[curr].get();
+		}
+		sensor.insert(section<uint32_t>(SENSOR), section<uint32_t>(SENSOR) + count(SENSOR));
+		internals.insert(section<uint32_t>(INTERNALS), section<uint32_t>(INTERNALS) + count(INTERNALS));
+		forward_interface.insert(section<uint32_t>(FORWARD_INTERFACE), section<uint32_t>(FORWARD_INTERFACE) + count(FORWARD_INTERFACE));
+
+		if (count(FACTORS) != order) {
+			cerr << "Error: compiled model has " << count(FACTORS) << " factors for " << order << " variables" << endl;
+			return -1;
+		}
+		const ImageFactor *records = section<ImageFactor>(FACTORS);
+		const uint32_t *scopes = section<uint32_t>(SCOPES);
+		const uint32_t *strides = section<uint32_t>(STRIDES);
+		const double *values = section<double>(VALUES);
+		for (unsigned i = 0; i < order; ++i) {
+			const ImageFactor &record = records[i];
+			if (record.scope + (uint64_t) record.width > count(SCOPES) || record.values + record.size > count(VALUES)) {
+				cerr << "Error: compiled model factor " << i << " out of bounds" << endl;
+				return -1;
+			}
+
+			vector<const Variable*> scope;
+			for (unsigned j = 0; j < record.width; ++j) {
+				uint32_t id = scopes[record.scope + j];
+				if (id >= order) return -1;
+				scope.push_back(variables[id].get());
+			}
+			Domain *domain = new Domain(scope);
+			bool consistent = (domain->size() == record.size);
+			for (unsigned j = 0; j < record.width; ++j) {
+				consistent = consistent && domain->offset(j) == strides[record.scope + j];
+			}
+			if (!consistent) {
+				cerr << "Error: compiled model factor " << i << " does not match its domain" << endl;
+				delete domain;
+				return -1;
+			}
+
+			factors.emplace_back(new Factor(domain, values + record.values, _file, record.partition));
+		}
+		return 0;
+	}
+
+	int ModelImage::read_addfactors(
+		ADDContext &context,
+		const vector<unique_ptr<Variable>> &variables,
+		const vector<shared_ptr<Factor>> &factors,
+		vector<shared_ptr<ADDFactor>> &addfactors) const {
+
+		if (!has_addfactors() || count(ADD_FACTORS) != factors.size()) return -1;
+
+		const uint32_t *groups = section<uint32_t>(GROUPS);
+		for (uint64_t i = 0; i < count(GROUPS); ) {
+			vector<const Variable*> group;
+			uint64_t size = groups[i++];
+			for (uint64_t j = 0; j < size && i < count(GROUPS); ++j) {
+				group.push_back(variables.at(groups[i++]).get());
+			}
+			context.group(group);
+		}
+
+		// node indices are only meaningful under the compiled encoding
+		const int32_t *encoding = section<int32_t>(ADD_ENCODING);
+		for (uint64_t i = 0; i + 1 < count(ADD_ENCODING); ) {
+			const vector<int> &indices = context.bits(variables.at(encoding[i]).get());
+			uint64_t nbits = encoding[i+1];
+			i += 2;
+			bool same = (indices.size() == nbits && i + nbits <= count(ADD_ENCODING) && equal(indices.begin(), indices.end(), encoding + i));
+			if (!same) {
+				cerr << "Error: compiled ADDs use a different variable encoding" << endl;
+				return -1;
+			}
+			i += nbits;
+		}
+
+		const ImageADD *records = section<ImageADD>(ADD_FACTORS);
+		const ADDFactor::Node *nodes = section<ADDFactor::Node>(ADD_NODES);
+		for (unsigned i = 0; i < factors.size(); ++i) {
+			if (records[i].first + records[i].count > count(ADD_NODES)) return -1;
+			for (uint64_t j = 0; j < records[i].count; ++j) {
+				const ADDFactor::Node &node = nodes[records[i].first + j];
+				if (node.index >= 0 && (node.high >= j || node.low >= j)) {
+					cerr << "Error: compiled ADD of factor " << i << " is corrupt" << endl;
+					return -1;
+				}
+			}
+			const Domain &domain = factors[i]->domain();
+			string output = to_string(domain[(unsigned)0]->id());
+			addfactors.emplace_back(new ADDFactor(context, output, nodes + records[i].first, records[i].count, domain));
+		}
+		return 0;
+	}
+
+}
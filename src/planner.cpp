@@ -0,0 +1,424 @@
+// Copyright (c) 2015 Thiago Pereira Bueno
+// All Rights Reserved.
+//
+// This file is part of DBN library.
+//
+// DBN is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// DBN is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DBN.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "planner.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <limits>
+#include <random>
+#include <tuple>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+using namespace std;
+
+namespace dbn {
+
+	static const unsigned PLAN_VERSION = 1;
+	static const unsigned EXACT_LIMIT = 12;
+	static const unsigned RESTARTS = 32;
+	static const unsigned RESTART_CHOICES = 3;
+
+	struct PlanTable {
+		vector<unsigned> scope;
+		double size;
+		bool intermediate;
+	};
+
+	struct PlanProblem {
+		vector<double> sizes;
+		vector<PlanTable> tables;
+		unordered_map<unsigned,unsigned> index;
+	};
+
+	static PlanProblem
+	plan_problem(const vector<const Variable*> &variables, const vector<vector<const Variable*>> &scopes)
+	{
+		PlanProblem problem;
+		auto local = [&problem](const Variable *v) {
+			unordered_map<unsigned,unsigned>::iterator it = problem.index.find(v->id());
+			if (it != problem.index.end()) return it->second;
+			unsigned i = problem.sizes.size();
+			problem.index[v->id()] = i;
+			problem.sizes.push_back(v->size());
+			return i;
+		};
+		for (auto pv : variables) {
+			local(pv);
+		}
+		for (auto const &scope : scopes) {
+			PlanTable table;
+			table.size = 1.0;
+			table.intermediate = false;
+			for (auto pv : scope) {
+				table.scope.push_back(local(pv));
+				table.size *= pv->size();
+			}
+			sort(table.scope.begin(), table.scope.end());
+			problem.tables.push_back(table);
+		}
+		return problem;
+	}
+
+	// cost of eliminating v from tables: entries of the bucket product times
+	// the number of factors multiplied and summed; optionally applies the step
+	static double
+	plan_step(vector<PlanTable> &tables, unsigned v, const vector<double> &sizes, double &peak, bool apply)
+	{
+		vector<unsigned> scope;
+		unsigned bucket = 0;
+		double live = 0.0;
+		for (auto const &table : tables) {
+			if (binary_search(table.scope.begin(), table.scope.end(), v)) {
+				vector<unsigned> merged;
+				set_union(scope.begin(), scope.end(), table.scope.begin(), table.scope.end(), back_inserter(merged));
+				scope.swap(merged);
+				bucket++;
+			}
+			else if (table.intermediate) {
+				live += table.size;
+			}
+		}
+		if (bucket == 0) return 0.0;
+
+		double size = 1.0;
+		for (auto i : scope) {
+			size *= sizes[i];
+		}
+		peak = max(peak, live + size);
+
+		if (apply) {
+			vector<PlanTable> remaining;
+			for (auto &table : tables) {
+				if (!binary_search(table.scope.begin(), table.scope.end(), v)) {
+					remaining.push_back(table);
+				}
+			}
+			scope.erase(find(scope.begin(), scope.end(), v));
+			PlanTable product;
+			product.scope = scope;
+			product.size = size / sizes[v];
+			product.intermediate = true;
+			remaining.push_back(product);
+			tables.swap(remaining);
+		}
+
+		return size * bucket;
+	}
+
+	static Planner::Plan
+	plan_cost(const vector<unsigned> &ordering, const PlanProblem &problem)
+	{
+		Planner::Plan plan;
+		plan.ordering = ordering;
+		plan.flops = 0.0;
+		plan.memory = 0.0;
+		vector<PlanTable> tables = problem.tables;
+		for (auto v : ordering) {
+			plan.flops += plan_step(tables, v, problem.sizes, plan.memory, true);
+		}
+		return plan;
+	}
+
+	// dynamic programming over subsets of eliminated variables
+	static vector<unsigned>
+	exact_ordering(const vector<unsigned> &eliminate, const PlanProblem &problem)
+	{
+		unsigned n = eliminate.size();
+		unsigned full = (1u << n);
+		vector<double> cost(full, numeric_limits<double>::infinity());
+		vector<int> last(full, -1);
+		vector<vector<PlanTable>> state(full);
+		vector<bool> reached(full, false);
+
+		cost[0] = 0.0;
+		state[0] = problem.tables;
+		reached[0] = true;
+		for (unsigned mask = 0; mask < full; ++mask) {
+			if (!reached[mask]) continue;
+			for (unsigned i = 0; i < n; ++i) {
+				if (mask & (1u << i)) continue;
+				unsigned next_mask = mask | (1u << i);
+				double peak = 0.0;
+				vector<PlanTable> next = state[mask];
+				double c = cost[mask] + plan_step(next, eliminate[i], problem.sizes, peak, true);
+				if (!reached[next_mask]) {
+					state[next_mask].swap(next);
+					reached[next_mask] = true;
+				}
+				if (c < cost[next_mask]) {
+					cost[next_mask] = c;
+					last[next_mask] = i;
+				}
+			}
+			vector<PlanTable>().swap(state[mask]);
+		}
+
+		vector<unsigned> ordering;
+		for (unsigned mask = full-1; mask != 0; mask &= ~(1u << last[mask])) {
+			ordering.push_back(eliminate[last[mask]]);
+		}
+		reverse(ordering.begin(), ordering.end());
+		return ordering;
+	}
+
+	// greedy on step cost; with a random generator picks among the cheapest steps
+	static vector<unsigned>
+	greedy_ordering(const vector<unsigned> &eliminate, const PlanProblem &problem, mt19937 *rng)
+	{
+		vector<PlanTable> tables = problem.tables;
+		vector<unsigned> remaining(eliminate);
+		vector<unsigned> ordering;
+		while (!remaining.empty()) {
+			vector<tuple<double,double,unsigned>> candidates;
+			unsigned nremaining = remaining.size();
+			for (unsigned k = 0; k < nremaining; ++k) {
+				double peak = 0.0;
+				double c = plan_step(tables, remaining[k], problem.sizes, peak, false);
+				candidates.emplace_back(c, peak, k);
+			}
+			sort(candidates.begin(), candidates.end());
+
+			unsigned pick = 0;
+			if (rng) {
+				uniform_int_distribution<unsigned> choice(0, min(RESTART_CHOICES, nremaining)-1);
+				pick = choice(*rng);
+			}
+			unsigned k = get<2>(candidates[pick]);
+			double peak = 0.0;
+			plan_step(tables, remaining[k], problem.sizes, peak, true);
+			ordering.push_back(remaining[k]);
+			remaining.erase(remaining.begin() + k);
+		}
+		return ordering;
+	}
+
+	static bool
+	make_directories(const string &path)
+	{
+		for (size_t pos = path.find('/', 1); ; pos = path.find('/', pos+1)) {
+			string prefix = path.substr(0, pos);
+			struct stat st;
+			if (stat(prefix.c_str(), &st) != 0 && mkdir(prefix.c_str(), 0755) != 0) return false;
+			if (pos == string::npos) break;
+		}
+		return true;
+	}
+
+	Planner::Planner(uint64_t key, const string &cache_dir) :
+		_key(key), _changed(false), _hits(0), _misses(0)
+	{
+		if (cache_dir.empty() || !make_directories(cache_dir)) return;
+
+		ostringstream filename;
+		filename << cache_dir << "/" << hex << setw(16) << setfill('0') << key << ".plan";
+		_filename = filename.str();
+
+		ifstream input_file(_filename);
+		string line;
+		while (getline(input_file, line)) {
+			if (line.empty() || line[0] == '#') continue;
+			istringstream input(line);
+			string name;
+			unsigned n;
+			Plan plan;
+			if (!(input >> name >> plan.flops >> plan.memory >> n)) continue;
+			plan.ordering.resize(n);
+			for (unsigned i = 0; i < n; ++i) {
+				input >> plan.ordering[i];
+			}
+			if (input) {
+				_plans[name] = plan;
+			}
+		}
+	}
+
+	vector<const Variable*>
+	Planner::ordering(
+		const string &name,
+		const vector<const Variable*> &variables,
+		const vector<vector<const Variable*>> &scopes,
+		const vector<const Variable*> &seed)
+	{
+		unordered_map<unsigned,const Variable*> by_id;
+		for (auto pv : variables) {
+			by_id[pv->id()] = pv;
+		}
+
+		// reuse cached plan if it eliminates exactly the same variables
+		unordered_map<string,Plan>::const_iterator it_plan = _plans.find(name);
+		if (it_plan != _plans.end()) {
+			const vector<unsigned> &ids = it_plan->second.ordering;
+			set<unsigned> planned(ids.begin(), ids.end());
+			bool valid = (planned.size() == ids.size() && ids.size() == by_id.size());
+			for (auto id : ids) {
+				valid = valid && by_id.count(id);
+			}
+			if (valid) {
+				_hits++;
+				vector<const Variable*> ordering;
+				for (auto id : ids) {
+					ordering.push_back(by_id[id]);
+				}
+				return ordering;
+			}
+		}
+		_misses++;
+
+		PlanProblem problem = plan_problem(variables, scopes);
+		vector<unsigned> eliminate;
+		for (auto pv : variables) {
+			eliminate.push_back(problem.index[pv->id()]);
+		}
+
+		vector<vector<unsigned>> candidates;
+		vector<unsigned> seed_ordering;
+		for (auto pv : seed) {
+			seed_ordering.push_back(problem.index[pv->id()]);
+		}
+		candidates.push_back(seed_ordering);
+		if (eliminate.size() <= EXACT_LIMIT) {
+			candidates.push_back(exact_ordering(eliminate, problem));
+		}
+		else {
+			candidates.push_back(greedy_ordering(eliminate, problem, nullptr));
+			mt19937 rng(_key);
+			for (unsigned r = 0; r < RESTARTS; ++r) {
+				candidates.push_back(greedy_ordering(eliminate, problem, &rng));
+			}
+		}
+
+		Plan best;
+		best.flops = numeric_limits<double>::infinity();
+		best.memory = numeric_limits<double>::infinity();
+		for (auto const &candidate : candidates) {
+			Plan plan = plan_cost(candidate, problem);
+			if (plan.flops < best.flops || (plan.flops == best.flops && plan.memory < best.memory)) {
+				best = plan;
+			}
+		}
+
+		vector<const Variable*> locals(problem.sizes.size());
+		for (auto pv : variables) {
+			locals[problem.index[pv->id()]] = pv;
+		}
+		vector<const Variable*> ordering;
+		for (auto &v : best.ordering) {
+			ordering.push_back(locals[v]);
+			v = locals[v]->id();
+		}
+		if (it_plan == _plans.end() || it_plan->second.ordering != best.ordering) {
+			_plans[name] = best;
+			_changed = true;
+		}
+
+		return ordering;
+	}
+
+	Planner::~Planner()
+	{
+		if (_changed) save();
+	}
+
+	Planner::Plan
+	Planner::evaluate(const vector<const Variable*> &ordering, const vector<vector<const Variable*>> &scopes)
+	{
+		PlanProblem problem = plan_problem(ordering, scopes);
+		vector<unsigned> local;
+		for (auto pv : ordering) {
+			local.push_back(problem.index[pv->id()]);
+		}
+		Plan plan = plan_cost(local, problem);
+		for (unsigned i = 0; i < ordering.size(); ++i) {
+			plan.ordering[i] = ordering[i]->id();
+		}
+		return plan;
+	}
+
+	void
+	Planner::save() const
+	{
+		if (_filename.empty()) return;
+
+		ofstream output_file(_filename);
+		if (!output_file.is_open()) return;
+		output_file << "# dbn elimination plans (version " << PLAN_VERSION << ")" << endl;
+		output_file << setprecision(17);
+		for (auto const &it_plan : _plans) {
+			const Plan &plan = it_plan.second;
+			output_file << it_plan.first << " " << plan.flops << " " << plan.memory << " " << plan.ordering.size();
+			for (auto id : plan.ordering) {
+				output_file << " " << id;
+			}
+			output_file << endl;
+		}
+	}
+
+	uint64_t
+	structure_hash(
+		const vector<unique_ptr<Variable>> &variables, const vector<shared_ptr<Factor>> &factors,
+		const set<unsigned> &sensor, const unordered_map<unsigned,const Variable*> &transition,
+		Graph::Heuristic heuristic)
+	{
+		// FNV-1a
+		uint64_t hash = 14695981039346656037ULL;
+		auto mix = [&hash](uint64_t value) {
+			for (unsigned i = 0; i < 8; ++i) {
+				hash ^= (value >> (8*i)) & 0xff;
+				hash *= 1099511628211ULL;
+			}
+		};
+
+		mix(PLAN_VERSION);
+		mix(heuristic);
+		mix(variables.size());
+		for (auto const &pv : variables) {
+			mix(pv->size());
+		}
+
+		set<pair<unsigned,unsigned>> pairs;
+		for (auto it_transition : transition) {
+			pairs.emplace(it_transition.second->id(), it_transition.first);
+		}
+		mix(pairs.size());
+		for (auto const &p : pairs) {
+			mix(p.first);
+			mix(p.second);
+		}
+
+		mix(sensor.size());
+		for (auto id : sensor) {
+			mix(id);
+		}
+
+		for (auto const &pf : factors) {
+			const Domain &domain = pf->domain();
+			mix(domain.width());
+			for (auto pv : domain.scope()) {
+				mix(pv->id());
+			}
+		}
+
+		return hash;
+	}
+
+}
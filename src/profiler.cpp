@@ -0,0 +1,110 @@
+// Copyright (c) 2015 Thiago Pereira Bueno
+// All Rights Reserved.
+//
+// This file is part of DBN library.
+//
+// DBN is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// DBN is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DBN.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "profiler.h"
+
+#include <algorithm>
+
+using namespace std;
+
+namespace dbn {
+
+	bool Profiler::_enabled = false;
+	thread_local ProfileCounters Profiler::_current;
+	thread_local Profile Profiler::_profile;
+
+	static const char *phase_names[Profiler::PHASES] = {
+		"model_load", "sensor_model", "projection", "conditioning", "update", "normalization", "output"
+	};
+
+	void ProfileCounters::add(const ProfileCounters &counters) {
+		for (unsigned p = 0; p < Profiler::PHASES; ++p) {
+			time[p] += counters.time[p];
+		}
+		products += counters.products;
+		sum_outs += counters.sum_outs;
+		entries += counters.entries;
+		max_factor = max(max_factor, counters.max_factor);
+		allocations += counters.allocations;
+	}
+
+	void ProfileCounters::write_json(ostream &os) const {
+		os << "{\"time_ms\": {";
+		for (unsigned p = 0; p < Profiler::PHASES; ++p) {
+			os << (p ? ", " : "") << "\"" << phase_names[p] << "\": " << time[p];
+		}
+		os << "}";
+		os << ", \"products\": " << products;
+		os << ", \"sum_outs\": " << sum_outs;
+		os << ", \"entries\": " << entries;
+		os << ", \"max_factor\": " << max_factor;
+		os << ", \"allocations\": " << allocations << "}";
+	}
+
+	void Profile::write_json(ostream &os, const string &indent) const {
+		os << "{" << endl;
+		os << indent << "  \"total\": ";
+		total.write_json(os);
+		os << "," << endl;
+		os << indent << "  \"setup\": ";
+		setup.write_json(os);
+		os << "," << endl;
+		os << indent << "  \"steps\": [";
+		for (unsigned t = 0; t < steps.size(); ++t) {
+			os << (t ? "," : "") << endl << indent << "    ";
+			steps[t].write_json(os);
+		}
+		os << endl << indent << "  ]" << endl;
+		os << indent << "}";
+	}
+
+	void Profiler::product(double entries, double result) {
+		_current.products++;
+		_current.entries += entries;
+		_current.max_factor = max(_current.max_factor, result);
+	}
+
+	void Profiler::sum_out(double entries, double result) {
+		_current.sum_outs++;
+		_current.entries += entries;
+		_current.max_factor = max(_current.max_factor, result);
+	}
+
+	void Profiler::end_setup() {
+		if (!_enabled) return;
+		_profile.setup.add(_current);
+		_profile.total.add(_current);
+		_current = ProfileCounters();
+	}
+
+	void Profiler::end_step() {
+		if (!_enabled) return;
+		_profile.steps.push_back(_current);
+		_profile.total.add(_current);
+		_current = ProfileCounters();
+	}
+
+	Profile Profiler::collect() {
+		// work outside the timesteps (e.g. output of a batch run) counts as setup
+		end_setup();
+		Profile profile = _profile;
+		_profile = Profile();
+		return profile;
+	}
+
+}
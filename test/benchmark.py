@@ -20,7 +20,7 @@ def run(inputs, gates, health, observations, output_filename):
 
 	# ./dbn
 	# Usage: ../dbn /path/to/model.duai /path/to/observations.duai.evid [OPTIONS]
-	dbn = "../dbn {f}.duai {f}.duai.evid -m 23".format(f=filename)
+	dbn = "../dbn {f}.duai {f}.duai.evid -m 234".format(f=filename)
 	print(dbn, end='\t')
 	start = time.time()
 	subprocess.call(shlex.split(dbn), stdout=open(output_filename, 'a'))
@@ -0,0 +1,293 @@
+// Copyright (c) 2015 Thiago Pereira Bueno
+// All Rights Reserved.
+//
+// This file is part of DBN library.
+//
+// DBN is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// DBN is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DBN.  If not, see <http://www.gnu.org/licenses/>.
+
+// End-to-end scaling benchmark. Models and observations are generated in
+// memory and filtered by each method, sweeping the same axes as
+// benchmark.py (sensor, interface and timeslices, on digital circuits)
+// plus the interface width of random DBNs.
+//
+// Usage: ./dbn-bench [-m methods] [-s sweep] [-n models] [-T timesteps] [-k cardinality]
+//                    [-p parents] [-z sparsity] [-w max interface] [-r seed] [-o results.json]
+
+#include "generator.h"
+#include "inference.h"
+#include "io.h"
+#include "planner.h"
+
+#include <cstdlib>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <utility>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <functional>
+#include <sys/resource.h>
+
+using namespace std;
+using namespace dbn;
+
+struct Record {
+	string sweep;
+	vector<pair<string,double>> parameters;
+	unsigned method;
+	unsigned steps;
+	double total_ms;
+	double peak_rss;
+	double peak_belief_bytes;
+	double avg_nodes, max_nodes;
+	long peak_live_nodes;
+};
+
+// peak resident set size in bytes (VmHWM, which reset_peak_rss() lowers to
+// the current size where supported; otherwise the process maximum)
+static double peak_rss()
+{
+	ifstream status("/proc/self/status");
+	string line;
+	while (getline(status, line)) {
+		if (line.compare(0, 6, "VmHWM:") == 0) {
+			return atof(line.c_str() + 6) * 1024.0;
+		}
+	}
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_maxrss * 1024.0;
+}
+
+static void reset_peak_rss()
+{
+	ofstream clear_refs("/proc/self/clear_refs");
+	if (clear_refs.is_open()) clear_refs << "5" << endl;
+}
+
+static double belief_bytes(const Factor &f) { return f.memory(); }
+static double belief_nodes(const Factor &) { return 0.0; }
+
+template<class T>
+static double belief_bytes(const T &) { return 0.0; }
+
+template<class T>
+static double belief_nodes(const T &f) { return f.node_count(); }
+
+template<class T>
+static EstimateSink<T> measure(Record &record)
+{
+	return [&record](const T &belief_state) {
+		++record.steps;
+		record.peak_belief_bytes = max(record.peak_belief_bytes, belief_bytes(belief_state));
+		double nodes = belief_nodes(belief_state);
+		record.avg_nodes += nodes;
+		record.max_nodes = max(record.max_nodes, nodes);
+	};
+}
+
+static Record run(Model &model, const Evidence &observations, unsigned method)
+{
+	Record record;
+	record.method = method;
+	record.steps = 0;
+	record.peak_belief_bytes = 0.0;
+	record.avg_nodes = record.max_nodes = 0.0;
+	record.peak_live_nodes = 0;
+
+	vector<const Variable*> vars;
+	for (auto const &v : model.variables) {
+		vars.push_back(v.get());
+	}
+
+	// plans are not persisted across generated models
+	Planner planner(structure_hash(model.variables, model.factors, model.sensor, model.transition, Graph::MIN_FILL));
+	FilteringRun run;
+	run.planner = &planner;
+
+	reset_peak_rss();
+	auto start = chrono::steady_clock::now();
+	if (method == 1) {
+		auto sink = measure<Factor>(record);
+		for (auto const &pf : unrolled_filtering(vars, model.factors, model.prior, model.sensor, model.internals, model.transition, observations, false, &run)) {
+			sink(*pf);
+		}
+	}
+	else if (method == 2) {
+		filtering(vars, model.factors, model.prior, model.sensor, model.internals, model.transition, model.forward_interface,
+			replay(observations), measure<Factor>(record), &run);
+	}
+	else if (method == 3) {
+		ADDContext context;
+		vector<shared_ptr<ADDFactor>> addfactors;
+		read_addfactors(context, model.factors, model.transition, addfactors);
+		filtering(vars, addfactors, model.prior, model.sensor, model.internals, model.transition, model.forward_interface,
+			replay(observations), measure<ADDFactor>(record), &run);
+		record.peak_live_nodes = context.statistics().peak_live_nodes;
+	}
+	else if (method == 4) {
+		junction_tree_filtering(vars, model.factors, model.prior, model.sensor, model.internals, model.transition,
+			replay(observations), measure<Factor>(record), &run);
+	}
+	else if (method == 5) {
+		EVDDFactor::reset();
+		vector<shared_ptr<EVDDFactor>> evddfactors;
+		read_evddfactors(model.factors, model.transition, evddfactors);
+		filtering(vars, evddfactors, model.prior, model.sensor, model.internals, model.transition, model.forward_interface,
+			replay(observations), measure<EVDDFactor>(record), &run);
+		record.peak_live_nodes = EVDDFactor::live_nodes();
+	}
+	auto end = chrono::steady_clock::now();
+	record.total_ms = chrono::duration<double, milli>(end - start).count();
+	record.peak_rss = peak_rss();
+
+	if (record.steps) record.avg_nodes /= record.steps;
+	return record;
+}
+
+static void write_json(ostream &os, const vector<Record> &records)
+{
+	os << "{" << endl;
+	os << "  \"runs\": [";
+	for (unsigned i = 0; i < records.size(); ++i) {
+		const Record &r = records[i];
+		os << (i ? "," : "") << endl << "    ";
+		os << "{\"sweep\": \"" << r.sweep << "\"";
+		for (auto const &p : r.parameters) {
+			os << ", \"" << p.first << "\": " << p.second;
+		}
+		os << ", \"method\": " << r.method;
+		os << ", \"timesteps\": " << r.steps;
+		os << ", \"total_ms\": " << r.total_ms;
+		os << ", \"ms_per_slice\": " << r.total_ms / max(r.steps, 1u);
+		os << ", \"peak_rss_bytes\": " << r.peak_rss;
+		os << ", \"peak_belief_bytes\": " << r.peak_belief_bytes;
+		os << ", \"belief_nodes_avg\": " << r.avg_nodes;
+		os << ", \"belief_nodes_max\": " << r.max_nodes;
+		os << ", \"peak_live_nodes\": " << r.peak_live_nodes << "}";
+	}
+	os << endl << "  ]" << endl;
+	os << "}" << endl;
+}
+
+int main(int argc, char *argv[])
+{
+	string methods = "234";
+	string sweep = "all";
+	unsigned models = 1;
+	unsigned timesteps = 100;
+	unsigned max_interface = 12;
+	RandomDBN random_parameters;
+	unsigned seed = 0;
+	string output_file;
+
+	for (int i = 1; i < argc; ++i) {
+		string option(argv[i]);
+		bool value = (i+1 < argc);
+		if (option == "-m" && value) methods = argv[++i];
+		else if (option == "-s" && value) sweep = argv[++i];
+		else if (option == "-n" && value) models = atoi(argv[++i]);
+		else if (option == "-T" && value) timesteps = atoi(argv[++i]);
+		else if (option == "-k" && value) random_parameters.cardinality = atoi(argv[++i]);
+		else if (option == "-p" && value) random_parameters.parents = atoi(argv[++i]);
+		else if (option == "-z" && value) random_parameters.sparsity = atof(argv[++i]);
+		else if (option == "-w" && value) max_interface = atoi(argv[++i]);
+		else if (option == "-r" && value) seed = atoi(argv[++i]);
+		else if (option == "-o" && value) output_file = argv[++i];
+		else {
+			cerr << "Usage: " << argv[0] << " [-m methods] [-s sensor|interface|timeslices|random|all] [-n models] [-T timesteps]" << endl;
+			cerr << "       [-k cardinality] [-p parents] [-z sparsity] [-w max interface] [-r seed] [-o results.json]" << endl;
+			return -1;
+		}
+	}
+	for (char m : methods) {
+		if (m < '1' || m > '5') {
+			cerr << "Error: wrong method option " << methods << endl;
+			return -1;
+		}
+	}
+
+	mt19937 generator(seed);
+	vector<Record> records;
+
+	auto benchmark = [&](const string &name, vector<pair<string,double>> parameters, unsigned T, function<void(Model&)> generate) {
+		for (unsigned i = 0; i < models; ++i) {
+			Model model;
+			generate(model);
+			Evidence observations = sample_observations(model, T, generator);
+			for (char m : methods) {
+				Record record = run(model, observations, m - '0');
+				record.sweep = name;
+				record.parameters = parameters;
+				record.parameters.emplace_back("model", i);
+				cerr << name;
+				for (auto const &p : record.parameters) cerr << " " << p.first << "=" << p.second;
+				cerr << " method=" << record.method << ": " << record.total_ms / max(record.steps, 1u) << " ms/slice" << endl;
+				records.push_back(record);
+			}
+		}
+	};
+
+	auto dc = [&](unsigned inputs, unsigned gates, unsigned health) {
+		return [&generator, inputs, gates, health](Model &model) { generate_dc(model, inputs, gates, health, generator); };
+	};
+
+	// same axes and defaults as benchmark.py
+	if (sweep == "sensor" || sweep == "all") {
+		unsigned gates = 17, health = 5;
+		for (unsigned inputs = 3; inputs <= gates; ++inputs) {
+			benchmark("sensor", { { "inputs", inputs }, { "gates", gates }, { "health", health } }, timesteps, dc(inputs, gates, health));
+		}
+	}
+	if (sweep == "interface" || sweep == "all") {
+		unsigned inputs = 5, gates = 2 * inputs;
+		for (unsigned health = 5; health <= gates; ++health) {
+			benchmark("interface", { { "inputs", inputs }, { "gates", gates }, { "health", health } }, timesteps, dc(inputs, gates, health));
+		}
+	}
+	if (sweep == "timeslices" || sweep == "all") {
+		unsigned inputs = 10, gates = 20, health = 7;
+		for (unsigned T = 50; T <= 500; T += 50) {
+			benchmark("timeslices", { { "inputs", inputs }, { "gates", gates }, { "health", health } }, T, dc(inputs, gates, health));
+		}
+	}
+	if (sweep == "random" || sweep == "all") {
+		for (unsigned width = 2; width <= max_interface; ++width) {
+			RandomDBN parameters = random_parameters;
+			parameters.interface = width;
+			parameters.sensors = width;
+			benchmark("random", {
+					{ "interface", width }, { "parents", min(parameters.parents, width) },
+					{ "cardinality", parameters.cardinality }, { "sparsity", parameters.sparsity } },
+				timesteps,
+				[&generator, parameters](Model &model) { generate_random_dbn(model, parameters, generator); });
+		}
+	}
+
+	if (output_file != "") {
+		ofstream output(output_file);
+		if (!output.is_open()) {
+			cerr << "Error: couldn't write file " << output_file << endl;
+			return -1;
+		}
+		write_json(output, records);
+	}
+	else {
+		write_json(cout, records);
+	}
+
+	return 0;
+}
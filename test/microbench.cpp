@@ -0,0 +1,273 @@
+// Copyright (c) 2015 Thiago Pereira Bueno
+// All Rights Reserved.
+//
+// This file is part of DBN library.
+//
+// DBN is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// DBN is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DBN.  If not, see <http://www.gnu.org/licenses/>.
+
+// Microbenchmarks of the factor kernels (Domain, Factor and ADDFactor) on a
+// grid of widths, cardinalities and sparsities. Each measurement is the
+// median of a number of repetitions, each long enough to be timed reliably,
+// and is reported per entry of the table the operation reads or writes.
+//
+// Usage: ./dbn-microbench [-r repetitions] [-o results.json] [-b name] [-q]
+
+#include "variable.h"
+#include "domain.h"
+#include "factor.h"
+#include "addcontext.h"
+#include "addfactor.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <unordered_map>
+#include <memory>
+#include <string>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <functional>
+
+using namespace std;
+using namespace dbn;
+
+// a CUDD node on 64-bit platforms: index, reference count, next pointer and
+// either a value or two children
+static const double DD_NODE_BYTES = 32.0;
+
+// minimum duration of one repetition, in ns
+static const double MIN_SAMPLE = 2e6;
+
+// largest table built by any benchmark
+static const double MAX_ENTRIES = 1 << 22;
+
+struct Result {
+	string name;
+	unsigned width;
+	unsigned cardinality;
+	double sparsity;
+	double entries;
+	unsigned iterations;
+	unsigned repetitions;
+	double median, min, mad;
+	double bytes;
+};
+
+// keeps the optimizer from discarding the results of the kernels
+static volatile double sink;
+
+static Result measure(const string &name, double entries, unsigned repetitions, function<double()> kernel)
+{
+	Result result;
+	result.name = name;
+	result.entries = entries;
+	result.repetitions = repetitions;
+
+	// calibrate iterations per repetition (after one warmup call)
+	unsigned iterations = 1;
+	sink = kernel();
+	while (true) {
+		auto start = chrono::steady_clock::now();
+		for (unsigned i = 0; i < iterations; ++i) sink = kernel();
+		double ns = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+		if (ns >= MIN_SAMPLE || iterations >= (1u << 20)) break;
+		iterations *= 2;
+	}
+	result.iterations = iterations;
+
+	vector<double> samples;
+	for (unsigned r = 0; r < repetitions; ++r) {
+		auto start = chrono::steady_clock::now();
+		for (unsigned i = 0; i < iterations; ++i) sink = kernel();
+		double ns = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+		samples.push_back(ns / iterations / entries);
+	}
+	sort(samples.begin(), samples.end());
+	result.median = samples[samples.size() / 2];
+	result.min = samples.front();
+
+	vector<double> deviations;
+	for (double s : samples) deviations.push_back(s > result.median ? s - result.median : result.median - s);
+	sort(deviations.begin(), deviations.end());
+	result.mad = deviations[deviations.size() / 2];
+
+	return result;
+}
+
+// table over scope with a fraction sparsity of zero entries
+static Factor random_factor(const vector<const Variable*> &scope, double sparsity, mt19937 &generator)
+{
+	uniform_real_distribution<double> uniform(0.0, 1.0);
+	Factor factor(new Domain(scope), 0.0);
+	double partition = 0.0;
+	for (unsigned i = 0; i < factor.size(); ++i) {
+		double value = (uniform(generator) < sparsity ? 0.0 : uniform(generator));
+		factor[i] = value;
+		partition += value;
+	}
+	factor.partition(partition);
+	return factor;
+}
+
+static void write_json(ostream &os, const vector<Result> &results)
+{
+	os << "{" << endl;
+	os << "  \"benchmarks\": [";
+	for (unsigned i = 0; i < results.size(); ++i) {
+		const Result &r = results[i];
+		os << (i ? "," : "") << endl << "    ";
+		os << "{\"name\": \"" << r.name << "\"";
+		os << ", \"width\": " << r.width;
+		os << ", \"cardinality\": " << r.cardinality;
+		os << ", \"sparsity\": " << r.sparsity;
+		os << ", \"entries\": " << r.entries;
+		os << ", \"iterations\": " << r.iterations;
+		os << ", \"repetitions\": " << r.repetitions;
+		os << ", \"ns_per_entry\": " << r.median;
+		os << ", \"ns_per_entry_min\": " << r.min;
+		os << ", \"ns_per_entry_mad\": " << r.mad;
+		os << ", \"bytes_per_entry\": " << r.bytes << "}";
+	}
+	os << endl << "  ]" << endl;
+	os << "}" << endl;
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned repetitions = 15;
+	string output_file, only;
+	bool quick = false;
+	for (int i = 1; i < argc; ++i) {
+		string option(argv[i]);
+		if (option == "-r" && i+1 < argc) repetitions = max(atoi(argv[++i]), 1);
+		else if (option == "-o" && i+1 < argc) output_file = argv[++i];
+		else if (option == "-b" && i+1 < argc) only = argv[++i];
+		else if (option == "-q") quick = true;
+		else {
+			cerr << "Usage: " << argv[0] << " [-r repetitions] [-o results.json] [-b name] [-q]" << endl;
+			return -1;
+		}
+	}
+
+	vector<unsigned> widths = { 2, 4, 8, 12, 16 };
+	vector<unsigned> cardinalities = { 2, 3, 4 };
+	vector<double> sparsities = { 0.0, 0.5, 0.9 };
+	if (quick) {
+		widths = { 4, 8 };
+		cardinalities = { 2 };
+		sparsities = { 0.0, 0.9 };
+	}
+
+	vector<Result> results;
+	for (unsigned width : widths) {
+		for (unsigned k : cardinalities) {
+			for (double sparsity : sparsities) {
+
+				// f1 over variables [0, width), f2 over [width/2, width/2 + width)
+				unsigned shift = width / 2;
+				double product_entries = 1.0;
+				for (unsigned i = 0; i < width + shift; ++i) product_entries *= k;
+				if (product_entries > MAX_ENTRIES) continue;
+
+				vector<unique_ptr<Variable>> variables;
+				vector<const Variable*> scope1, scope2;
+				for (unsigned id = 0; id < width + shift; ++id) {
+					variables.emplace_back(new Variable(id, k));
+					if (id < width) scope1.push_back(variables.back().get());
+					if (id >= shift) scope2.push_back(variables.back().get());
+				}
+
+				mt19937 generator(width * 1000 + k * 10 + unsigned(sparsity * 10));
+				Factor f1 = random_factor(scope1, sparsity, generator);
+				Factor f2 = random_factor(scope2, sparsity, generator);
+				const Variable *middle = scope1[width / 2];
+				unordered_map<unsigned,unsigned> evidence = { { scope1[0]->id(), k - 1 } };
+				double entries = f1.size();
+
+				ADDContext context;
+				ADDFactor a1(context, "T", f1);
+				ADDFactor a2(context, "T", f2);
+
+				vector<Result> config;
+				auto run = [&](const string &name, double n, function<double()> kernel, function<double()> bytes) {
+					if (only != "" && name.find(only) == string::npos) return;
+					Result result = measure(name, n, repetitions, kernel);
+					result.bytes = bytes() / n;
+					config.push_back(result);
+				};
+
+				run("domain", entries,
+					[&]() { Domain d(scope1); return double(d.size()); },
+					[&]() { return double(Domain(scope1).memory()); });
+				run("domain_join", product_entries,
+					[&]() { Domain d(f1.domain(), f2.domain()); return double(d.size()); },
+					[&]() { return double(Domain(f1.domain(), f2.domain()).memory()); });
+				run("factor_product", product_entries,
+					[&]() { return f1.product(f2).partition(); },
+					[&]() { return double(f1.product(f2).memory()); });
+				run("factor_sum_out", entries,
+					[&]() { return f1.sum_out(middle).partition(); },
+					[&]() { return double(f1.sum_out(middle).memory()); });
+				run("factor_conditioning", entries,
+					[&]() { return f1.conditioning(evidence).partition(); },
+					[&]() { return double(f1.conditioning(evidence).memory()); });
+				run("factor_normalize", entries,
+					[&]() { return f1.normalize().partition(); },
+					[&]() { return double(f1.normalize().memory()); });
+
+				run("add_build", entries,
+					[&]() { return double(ADDFactor(context, "T", f1).node_count()); },
+					[&]() { return ADDFactor(context, "T", f1).node_count() * DD_NODE_BYTES; });
+				run("add_product", product_entries,
+					[&]() { return a1.product(a2).partition(); },
+					[&]() { return a1.product(a2).node_count() * DD_NODE_BYTES; });
+				run("add_sum_out", entries,
+					[&]() { return a1.sum_out(middle).partition(); },
+					[&]() { return a1.sum_out(middle).node_count() * DD_NODE_BYTES; });
+				run("add_conditioning", entries,
+					[&]() { return a1.conditioning(evidence).partition(); },
+					[&]() { return a1.conditioning(evidence).node_count() * DD_NODE_BYTES; });
+				run("add_normalize", entries,
+					[&]() { return a1.normalize().partition(); },
+					[&]() { return a1.normalize().node_count() * DD_NODE_BYTES; });
+
+				for (auto &result : config) {
+					result.width = width;
+					result.cardinality = k;
+					result.sparsity = sparsity;
+					cerr << result.name << " width=" << width << " k=" << k << " sparsity=" << sparsity;
+					cerr << ": " << result.median << " ns/entry, " << result.bytes << " bytes/entry" << endl;
+					results.push_back(result);
+				}
+			}
+		}
+	}
+
+	if (output_file != "") {
+		ofstream output(output_file);
+		if (!output.is_open()) {
+			cerr << "Error: couldn't write file " << output_file << endl;
+			return -1;
+		}
+		write_json(output, results);
+	}
+	else {
+		write_json(cout, results);
+	}
+
+	return 0;
+}